@@ -0,0 +1,81 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+/*  Measures the overhead of `run<K>` relative to calling `K::op<M>`
+ *  directly. Build with -Dkernelpp_STATIC_MODE=<mode> to compare
+ *  compile-time and run-time mode selection.
+ */
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace kernelpp;
+
+namespace
+{
+    KERNEL_DECL(accumulate, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M> static void op(int* acc) { *acc += 1; }
+    };
+
+    /* keep the compiler from eliding the calls */
+    volatile int sink;
+
+    template <typename F>
+    double ns_per_call(size_t n, F&& f)
+    {
+        using clock = std::chrono::steady_clock;
+
+        const auto t0 = clock::now();
+        for (size_t i = 0; i < n; i++) { f(); }
+        const std::chrono::duration<double, std::nano> dt = clock::now() - t0;
+
+        return dt.count() / n;
+    }
+}
+
+int main()
+{
+    const size_t n = 50000000;
+    int acc = 0;
+
+#if defined(kernelpp_STATIC_MODE)
+    constexpr compute_mode direct = detail::static_resolve<accumulate>::value;
+    std::printf("static mode: %s\n", to_str(static_mode));
+#else
+    const compute_mode direct = compute_traits<compute_mode::AVX>::available() ?
+        compute_mode::AVX : compute_mode::CPU;
+    std::printf("static mode: (none)\n");
+#endif
+
+    const double t_direct = ns_per_call(n, [&]() {
+        if (direct == compute_mode::AVX) { accumulate::op<compute_mode::AVX>(&acc); }
+        else                             { accumulate::op<compute_mode::CPU>(&acc); }
+        sink = acc;
+    });
+
+    const double t_run = ns_per_call(n, [&]() {
+        run<accumulate>(&acc);
+        sink = acc;
+    });
+
+    std::printf("direct (%s): %.3f ns/call\n", to_str(direct), t_direct);
+    std::printf("run<K>:      %.3f ns/call\n", t_run);
+    std::printf("overhead:    %.3f ns/call\n", t_run - t_direct);
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+/*  Compares `z = exp(a*x + b) * mask` evaluated as three element-wise
+ *  kernels, each streaming its operands through memory, with the same
+ *  expression fused in to a single pass with `expr::assign`.
+ */
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/expr.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    /* the unfused kernels, each generated from a single expression by
+       the same loop as the fused one */
+    template <compute_mode M, typename E>
+    void eval(gsl::span<float> y, const E& e) {
+        expr::detail::fused_loop<M>::run(y.data(), e, 0, y.size());
+    }
+
+    KERNEL_DECL(axpb, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static void op(gsl::span<float> y, gsl::span<const float> x, float a, float b) {
+            eval<M>(y, a * expr::view(x) + b);
+        }
+    };
+
+    KERNEL_DECL(vexp, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static void op(gsl::span<float> y, gsl::span<const float> x) {
+            eval<M>(y, expr::exp(expr::view(x)));
+        }
+    };
+
+    KERNEL_DECL(vmul, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static void op(gsl::span<float> y, gsl::span<const float> x, gsl::span<const float> w) {
+            eval<M>(y, expr::view(x) * expr::view(w));
+        }
+    };
+
+    template <typename F>
+    double seconds_per_call(size_t reps, F&& f)
+    {
+        using clock = std::chrono::steady_clock;
+
+        f();
+        const auto t0 = clock::now();
+        for (size_t i = 0; i < reps; i++) { f(); }
+        const std::chrono::duration<double> dt = clock::now() - t0;
+
+        return dt.count() / reps;
+    }
+
+    template <compute_mode M>
+    void compare(size_t n, size_t reps)
+    {
+        std::vector<float> x(n), mask(n), y(n), z(n);
+        for (size_t i = 0; i < n; i++) {
+            x[i] = float(i % 1000) / 1000.0f;
+            mask[i] = float(i % 2);
+        }
+
+        const float a = 1.5f, b = -0.5f;
+
+        const double t_unfused = seconds_per_call(reps, [&]() {
+            run<axpb, M>(gsl::span<float>(y), gsl::span<const float>(x), a, b);
+            run<vexp, M>(gsl::span<float>(y), gsl::span<const float>(y));
+            run<vmul, M>(gsl::span<float>(z), gsl::span<const float>(y), gsl::span<const float>(mask));
+        });
+
+        const double t_fused = seconds_per_call(reps, [&]() {
+            expr::assign<M>(z, expr::exp(a * expr::view(x) + b) * expr::view(mask));
+        });
+
+        /* bytes moved per element: read x, write y; read y, write y;
+           read y and mask, write z. Fused: read x and mask, write z. */
+        const double unfused_bytes = 7.0 * sizeof(float) * n;
+        const double fused_bytes = 3.0 * sizeof(float) * n;
+
+        std::printf("%-4s %10zu  unfused %9.3f ms %7.2f GB/s  fused %9.3f ms %7.2f GB/s  speedup %.2fx\n",
+            to_str(M), n,
+            t_unfused * 1e3, unfused_bytes / t_unfused * 1e-9,
+            t_fused * 1e3, fused_bytes / t_fused * 1e-9,
+            t_unfused / t_fused);
+    }
+}
+
+int main()
+{
+    std::printf("memory traffic per element: unfused 28 bytes, fused 12 bytes\n");
+
+    /* in cache, and well beyond the last level cache */
+    for (size_t n : { size_t(1) << 14, size_t(1) << 24 }) {
+        const size_t reps = (size_t(1) << 28) / n;
+
+        compare<compute_mode::CPU>(n, reps);
+        if (compute_traits<compute_mode::AVX>::enabled &&
+            compute_traits<compute_mode::AVX>::available()) {
+            compare<compute_mode::AVX>(n, reps);
+        }
+    }
+    return 0;
+}
@@ -18,6 +18,25 @@ limitations under the License.  */
 #include <cstddef>
 #include <type_traits>
 
+/*  Marks a function as compiled for AVX2, so it may use the corresponding
+ *  intrinsics irrespective of the flags used for the rest of the translation
+ *  unit. Such functions must only be reached once `init_avx()` succeeds.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#   define kernelpp_AVX_FN __attribute__((target("avx2")))
+#else
+#   define kernelpp_AVX_FN
+#endif
+
+/*  As `kernelpp_AVX_FN`, additionally allowing FMA intrinsics. Such functions
+ *  must only be reached once `cpu_features()` reports `isa::FMA`.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#   define kernelpp_FMA_FN __attribute__((target("avx2,fma")))
+#else
+#   define kernelpp_FMA_FN
+#endif
+
 namespace kernelpp
 {
     /*  Check avx is available and perform any required
@@ -25,6 +44,26 @@ namespace kernelpp
      */
     bool init_avx();
 
+    /*  Instruction set features, as reported by `cpu_features()` */
+    namespace isa
+    {
+        enum : uint32_t
+        {
+            AVX      = 1u << 0,
+            AVX2     = 1u << 1,
+            FMA      = 1u << 2,
+            AVX512F  = 1u << 3,
+            AVX512DQ = 1u << 4,
+            AVX512BW = 1u << 5,
+            AVX512VL = 1u << 6
+        };
+    }
+
+    /*  The instruction set features supported by both the CPU and
+     *  the OS, as a combination of `isa` flags.
+     */
+    uint32_t cpu_features();
+
     /*  True if the given pointer is nullptr or aligned
      *  to std::alignment_of(T) * N, false otherwise.
      */
@@ -0,0 +1,474 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <gsl.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#   define kernelpp_REPLAY_EXPORT extern "C" __declspec(dllexport)
+#else
+#   define kernelpp_REPLAY_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+/*  Defines the entry point of a replay plugin, a shared object which
+ *  registers the kernels `kernelpp_replay` can re-run:
+ *
+ *      kernelpp_REPLAY_PLUGIN()
+ *      {
+ *          registry.add<saxpy, gsl::span<float>, gsl::span<const float>, float>();
+ *      }
+ */
+#define kernelpp_REPLAY_PLUGIN() \
+    kernelpp_REPLAY_EXPORT void kernelpp_replay_register(::kernelpp::replay_registry& registry)
+
+namespace kernelpp
+{
+    /*  A serialized kernel argument or result */
+    struct capture_arg
+    {
+        enum kind_t : uint8_t { SCALAR = 0, ARRAY = 1 };
+
+        uint8_t kind;
+
+        /* the element type: its size in bytes, with 0x20 set for
+           signed integers and 0x40 for floating point types */
+        uint8_t elem;
+        uint64_t count;
+        std::vector<uint8_t> bytes;
+    };
+
+    /*  A captured kernel invocation */
+    struct capture_record
+    {
+        std::string kernel;
+        compute_mode mode;
+
+        /* the duration of the captured invocation */
+        double seconds;
+
+        /* the arguments, as they were before the invocation */
+        std::vector<capture_arg> args;
+    };
+
+    /*  `capture_traits<T>` serializes kernel arguments of type `T`, and
+     *  recreates them for replay from `storage`. Arithmetic and enum
+     *  types, `gsl::span<T>` and `std::vector<T>` of arithmetic `T` are
+     *  supported; specialize it for other argument types.
+     */
+    template <typename T, typename = void>
+    struct capture_traits;
+
+    /*  Appends capture records to a file. Records are optionally
+     *  compressed (with zlib, when built with kernelpp_WITH_ZLIB).
+     *  Writing is thread-safe.
+     */
+    class capture_writer final
+    {
+        struct impl;
+        struct impl_deleter { void operator()(impl*) const; };
+        std::unique_ptr<impl, impl_deleter> m_impl;
+
+      public:
+        capture_writer();
+        ~capture_writer();
+
+        /*  Creates the file at `path`, replacing any existing file */
+        status open(const char* path, bool compress = false);
+
+        /*  Writes an encoded record; see `capture_runner` */
+        status write(const std::string& record);
+
+        void close();
+
+        size_t records() const;
+        size_t dropped() const;
+    };
+
+    class capture_reader final
+    {
+        struct impl;
+        struct impl_deleter { void operator()(impl*) const; };
+        std::unique_ptr<impl, impl_deleter> m_impl;
+
+      public:
+        capture_reader();
+        ~capture_reader();
+
+        status open(const char* path);
+
+        /*  Reads the next record in to `r`. Returns false at the end of the file */
+        maybe<bool> next(capture_record& r);
+    };
+
+    /*  `capture_runner<K>` records invocations of `K` to a
+     *  `capture_writer`: every `every`th invocation, the invocation
+     *  following a call to `arm()`, and, when `capture_slower_than` is
+     *  set, any invocation that takes longer than the threshold. The
+     *  latter requires the arguments of every invocation to be
+     *  serialized up front, which is expensive for large arguments.
+     */
+    template <typename K>
+    struct capture_runner : public runner<K>
+    {
+        using typename runner<K>::traits;
+        using clock = std::chrono::steady_clock;
+
+        capture_runner(capture_writer* writer, size_t every = 0)
+            : m_writer(writer), m_every(every)
+        {}
+
+        /*  Captures the next invocation */
+        void arm() { m_armed.store(true, std::memory_order_relaxed); }
+
+        void capture_slower_than(std::chrono::microseconds threshold) { m_threshold = threshold; }
+
+        template <compute_mode M, typename... Args>
+        auto apply(Args&&... args) -> result<K, Args...>;
+
+      private:
+        capture_writer* m_writer;
+        size_t m_every;
+        std::chrono::microseconds m_threshold{ 0 };
+        std::atomic<size_t> m_calls{ 0 };
+        std::atomic<bool> m_armed{ false };
+    };
+
+    /*  Agreement between the outputs of two replays */
+    struct capture_diff
+    {
+        /* false if the outputs differ in shape or type */
+        bool comparable = true;
+
+        /* the number of elements outside the tolerance */
+        size_t mismatched = 0;
+
+        double max_abs = 0;
+        double max_rel = 0;
+
+        bool matches() const { return comparable && mismatched == 0; }
+    };
+
+    /*  Compares outputs element-wise. Integers must be equal, and
+     *  floating point elements within `tolerance` relative error.
+     */
+    capture_diff compare(const std::vector<capture_arg>& a,
+                         const std::vector<capture_arg>& b, double tolerance = 1e-5);
+
+    struct replay_result
+    {
+        compute_mode mode;
+        status result;
+
+        /* the fastest of the repetitions */
+        double seconds = 0;
+
+        /* the arguments after the invocation, followed by the result */
+        std::vector<capture_arg> outputs;
+    };
+
+    /*  Maps kernel names to functions which re-run captured invocations */
+    class replay_registry final
+    {
+      public:
+        using invoker = replay_result (*)(const capture_record&, compute_mode, size_t reps);
+
+        static replay_registry& instance();
+
+        /*  Registers `K`, invoked with arguments of types `Args...` */
+        template <typename K, typename... Args>
+        void add();
+
+        void add(const std::string& kernel, invoker fn) { m_invokers[kernel] = fn; }
+
+        /*  Loads a plugin defined with kernelpp_REPLAY_PLUGIN */
+        status load_plugin(const char* path);
+
+        invoker find(const std::string& kernel) const;
+
+      private:
+        std::unordered_map<std::string, invoker> m_invokers;
+    };
+
+    /*  Re-runs `r` with compute mode `m`, `reps` times */
+    replay_result replay(const replay_registry& registry, const capture_record& r,
+                         compute_mode m, size_t reps = 1);
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    namespace detail
+    {
+        template <typename T>
+        constexpr uint8_t capture_elem() {
+            return uint8_t(sizeof(T) |
+                (std::is_floating_point<T>::value ? 0x40 :
+                 std::is_signed<T>::value ? 0x20 : 0));
+        }
+
+        inline void capture_put(std::string& out, const void* p, size_t n) {
+            out.append(static_cast<const char*>(p), n);
+        }
+
+        inline void capture_put_arg(std::string& out, uint8_t kind, uint8_t elem,
+                                    uint64_t count, const void* data, size_t bytes)
+        {
+            out += char(kind);
+            out += char(elem);
+            capture_put(out, &count, sizeof(count));
+            if (bytes) { capture_put(out, data, bytes); }
+        }
+
+        inline status capture_check(const capture_arg& a, uint8_t kind, uint8_t elem)
+        {
+            if (a.kind != kind || a.elem != elem) {
+                return status{ "captured argument type mismatch" };
+            }
+            return status();
+        }
+
+        /*  The record header; the arguments follow */
+        std::string capture_header(const char* kernel, compute_mode m, double seconds, size_t args);
+
+        /*  Decodes arguments encoded with capture_traits<T>::write */
+        status capture_parse(const std::string& bytes, std::vector<capture_arg>& args);
+
+        template <typename T>
+        using scalar_t = std::conditional_t<std::is_enum<T>::value,
+            std::underlying_type<T>, std::common_type<T>>;
+    }
+
+    template <typename T>
+    struct capture_traits<T, std::enable_if_t<
+        std::is_arithmetic<T>::value || std::is_enum<T>::value
+        >>
+    {
+        using storage = T;
+        using element = typename detail::scalar_t<T>::type;
+
+        static void write(std::string& out, const T& v) {
+            detail::capture_put_arg(out, capture_arg::SCALAR,
+                detail::capture_elem<element>(), 1, &v, sizeof(T));
+        }
+
+        static status read(const capture_arg& a, storage& s)
+        {
+            if (auto err = detail::capture_check(a, capture_arg::SCALAR, detail::capture_elem<element>())) {
+                return err;
+            }
+            std::memcpy(&s, a.bytes.data(), sizeof(T));
+            return status();
+        }
+
+        static T& view(storage& s) { return s; }
+    };
+
+    template <typename T>
+    struct capture_traits<gsl::span<T>, std::enable_if_t<std::is_arithmetic<std::remove_cv_t<T>>::value>>
+    {
+        using storage = std::vector<std::remove_cv_t<T>>;
+
+        static void write(std::string& out, const gsl::span<T>& v) {
+            detail::capture_put_arg(out, capture_arg::ARRAY,
+                detail::capture_elem<std::remove_cv_t<T>>(), v.size(), v.data(), v.size() * sizeof(T));
+        }
+
+        static status read(const capture_arg& a, storage& s)
+        {
+            if (auto err = detail::capture_check(a, capture_arg::ARRAY, detail::capture_elem<std::remove_cv_t<T>>())) {
+                return err;
+            }
+            s.resize(a.count);
+            if (a.count) { std::memcpy(s.data(), a.bytes.data(), a.count * sizeof(T)); }
+            return status();
+        }
+
+        static gsl::span<T> view(storage& s) { return gsl::span<T>(s.data(), s.size()); }
+    };
+
+    template <typename T>
+    struct capture_traits<std::vector<T>, std::enable_if_t<std::is_arithmetic<T>::value>>
+    {
+        using storage = std::vector<T>;
+
+        static void write(std::string& out, const std::vector<T>& v) {
+            detail::capture_put_arg(out, capture_arg::ARRAY,
+                detail::capture_elem<T>(), v.size(), v.data(), v.size() * sizeof(T));
+        }
+
+        static status read(const capture_arg& a, storage& s) {
+            return capture_traits<gsl::span<T>>::read(a, s);
+        }
+
+        static std::vector<T>& view(storage& s) { return s; }
+    };
+
+    namespace detail
+    {
+        inline void capture_args(std::string&) {}
+
+        template <typename T, typename... Ts>
+        void capture_args(std::string& out, const T& x, const Ts&... xs)
+        {
+            capture_traits<std::decay_t<T>>::write(out, x);
+            capture_args(out, xs...);
+        }
+    }
+
+    template <typename K>
+    template <compute_mode M, typename... Args>
+    auto capture_runner<K>::apply(Args&&... args) -> result<K, Args...>
+    {
+        /* modes the kernel doesn't support are attempted, but not counted */
+        if (!K::template supports<M>::value) {
+            return runner<K>::template apply<M>(std::forward<Args>(args)...);
+        }
+
+        const size_t n = m_calls.fetch_add(1, std::memory_order_relaxed) + 1;
+        const bool slow = m_threshold.count() > 0;
+
+        bool capture = m_every > 0 && n % m_every == 0;
+        const bool armed = m_armed.load(std::memory_order_relaxed) && m_armed.exchange(false);
+
+        if (!capture && !armed && !slow) {
+            return runner<K>::template apply<M>(std::forward<Args>(args)...);
+        }
+
+        /* the arguments are captured before they may be modified */
+        std::string body;
+        detail::capture_args(body, args...);
+
+        const clock::time_point t0 = clock::now();
+        result<K, Args...> r = runner<K>::template apply<M>(std::forward<Args>(args)...);
+        const std::chrono::duration<double> dt = clock::now() - t0;
+
+        /* an attempt in a mode which didn't run isn't an invocation */
+        const error_code e = op_traits<K, Args...>::get_errc(r);
+        if (e == error_code::KERNEL_NOT_DEFINED ||
+            e == error_code::COMPUTE_MODE_UNAVAILABLE ||
+            e == error_code::COMPUTE_MODE_DISABLED)
+        {
+            if (armed) { arm(); }
+            return r;
+        }
+
+        if (capture || armed || dt > m_threshold) {
+            m_writer->write(detail::capture_header(traits::name, M, dt.count(), sizeof...(Args)) + body);
+        }
+        return r;
+    }
+
+    namespace detail
+    {
+        template <typename K, typename... Args>
+        auto run_in(compute_mode m, Args&&... args)
+            -> decltype(kernelpp::run<K>(std::forward<Args>(args)...))
+        {
+            switch (m) {
+            case compute_mode::CUDA: return kernelpp::run<K, compute_mode::CUDA>(std::forward<Args>(args)...);
+            case compute_mode::AVX:  return kernelpp::run<K, compute_mode::AVX>(std::forward<Args>(args)...);
+            case compute_mode::CPU:  return kernelpp::run<K, compute_mode::CPU>(std::forward<Args>(args)...);
+            default:                 return kernelpp::run<K>(std::forward<Args>(args)...);
+            }
+        }
+
+        inline status capture_result(std::string&, const status& s) { return s; }
+
+        template <typename R>
+        status capture_result(std::string& out, const maybe<R>& r)
+        {
+            if (r.template is<error>()) { return status{ r.template get<error>() }; }
+            capture_traits<R>::write(out, r.template get<R>());
+            return status();
+        }
+
+        template <typename T>
+        using capture_traits_of = capture_traits<std::decay_t<T>>;
+
+        template <typename K, typename... Args, size_t... Is>
+        replay_result replay_invoke(const capture_record& rec, compute_mode m, size_t reps,
+                                    std::index_sequence<Is...>)
+        {
+            using clock = std::chrono::steady_clock;
+
+            replay_result r;
+            r.mode = m;
+
+            if (rec.args.size() != sizeof...(Args)) {
+                r.result = status{ "captured argument count mismatch" };
+                return r;
+            }
+
+            std::tuple<typename capture_traits_of<Args>::storage...> st;
+            std::string out;
+
+            for (size_t i = 0; i < std::max<size_t>(reps, 1); i++)
+            {
+                /* each repetition starts from the captured arguments */
+                status decoded[] = {
+                    capture_traits_of<Args>::read(rec.args[Is], std::get<Is>(st))..., status() };
+
+                for (status& s : decoded) {
+                    if (s) { r.result = s; return r; }
+                }
+
+                const clock::time_point t0 = clock::now();
+                auto result = run_in<K>(m, capture_traits_of<Args>::view(std::get<Is>(st))...);
+                const std::chrono::duration<double> dt = clock::now() - t0;
+
+                if (i == 0 || dt.count() < r.seconds) { r.seconds = dt.count(); }
+
+                out.clear();
+                r.result = capture_result(out, result);
+                if (r.result) { return r; }
+            }
+
+            /* the arguments after the final repetition, then the result */
+            std::string args;
+            capture_args(args, capture_traits_of<Args>::view(std::get<Is>(st))...);
+
+            r.result = capture_parse(args + out, r.outputs);
+            return r;
+        }
+
+        template <typename K, typename... Args>
+        replay_result replay_invoker(const capture_record& rec, compute_mode m, size_t reps)
+        {
+            return replay_invoke<K, Args...>(rec, m, reps, std::index_sequence_for<Args...>());
+        }
+    }
+
+    template <typename K, typename... Args>
+    void replay_registry::add()
+    {
+        add(K::traits::name, &detail::replay_invoker<K, Args...>);
+    }
+}
@@ -0,0 +1,187 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <gsl.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace kernelpp
+{
+    struct coalesce_stats
+    {
+        size_t calls = 0;
+        size_t batches = 0;
+        size_t max_batch = 0;
+
+        /* batch_sizes[n] is the number of batches of n calls */
+        std::vector<size_t> batch_sizes;
+
+        /* time calls spent waiting for their batch to start */
+        double wait_seconds = 0;
+        double max_wait_seconds = 0;
+
+        double mean_batch() const { return batches ? double(calls) / batches : 0; }
+        double mean_wait() const { return calls ? wait_seconds / calls : 0; }
+    };
+
+    /*  `coalescer<K, In, Out>` combines concurrent invocations of the
+     *  batched kernel `K`, which has the form
+     *
+     *      template <compute_mode M>
+     *      static void op(gsl::span<const In> in, gsl::span<Out> out);
+     *
+     *  in to a single call. The first caller to arrive leads a batch: it
+     *  waits up to `max_wait` for others to join, or until the batch holds
+     *  `max_batch` calls, then runs the kernel on behalf of all of them.
+     *  Each caller blocks until its own result is available.
+     */
+    template <typename K, typename In, typename Out, compute_mode M = compute_mode::AUTO>
+    class coalescer final
+    {
+        using clock = std::chrono::steady_clock;
+
+        struct batch
+        {
+            std::vector<In> in;
+            std::vector<Out> out;
+            std::vector<clock::time_point> arrived;
+
+            bool closed = false;
+            bool done = false;
+            status result;
+
+            std::condition_variable cv;
+        };
+
+        size_t m_max_batch;
+        std::chrono::microseconds m_max_wait;
+
+        mutable std::mutex m_mtx;
+        std::shared_ptr<batch> m_open;
+        coalesce_stats m_stats;
+
+      public:
+        coalescer(size_t max_batch, std::chrono::microseconds max_wait);
+
+        coalescer(const coalescer&) = delete;
+        coalescer& operator=(const coalescer&) = delete;
+
+        /*  Invokes `K` on `x` as part of a batch */
+        maybe<Out> run(const In& x);
+
+        coalesce_stats stats() const;
+
+      private:
+        void close(batch& b);
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    template <typename K, typename In, typename Out, compute_mode M>
+    coalescer<K, In, Out, M>::coalescer(size_t max_batch, std::chrono::microseconds max_wait)
+        : m_max_batch{ std::max<size_t>(max_batch, 1) }, m_max_wait{ max_wait }
+    {
+        m_stats.batch_sizes.resize(m_max_batch + 1);
+    }
+
+    template <typename K, typename In, typename Out, compute_mode M>
+    void coalescer<K, In, Out, M>::close(batch& b)
+    {
+        /* m_mtx must be held */
+        b.closed = true;
+        if (m_open.get() == &b) { m_open.reset(); }
+    }
+
+    template <typename K, typename In, typename Out, compute_mode M>
+    maybe<Out> coalescer<K, In, Out, M>::run(const In& x)
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+
+        const bool leader = !m_open;
+        if (leader) {
+            m_open = std::make_shared<batch>();
+            m_open->in.reserve(m_max_batch);
+            m_open->arrived.reserve(m_max_batch);
+        }
+
+        std::shared_ptr<batch> b = m_open;
+        const size_t index = b->in.size();
+
+        b->in.push_back(x);
+        b->arrived.push_back(clock::now());
+
+        if (b->in.size() == m_max_batch) {
+            close(*b);
+            b->cv.notify_all();
+        }
+
+        if (leader)
+        {
+            const clock::time_point deadline = b->arrived[0] + m_max_wait;
+            b->cv.wait_until(lock, deadline, [&]() { return b->closed; });
+            close(*b);
+
+            const clock::time_point start = clock::now();
+            const size_t n = b->in.size();
+
+            m_stats.calls += n;
+            m_stats.batches++;
+            m_stats.max_batch = std::max(m_stats.max_batch, n);
+            m_stats.batch_sizes[n]++;
+
+            for (const clock::time_point& t : b->arrived) {
+                const std::chrono::duration<double> dt = start - t;
+                m_stats.wait_seconds += dt.count();
+                m_stats.max_wait_seconds = std::max(m_stats.max_wait_seconds, dt.count());
+            }
+
+            /* the batch is closed, so it can be read without the lock */
+            lock.unlock();
+            b->out.resize(n);
+
+            status s = kernelpp::run<K, M>(
+                gsl::span<const In>(b->in.data(), n), gsl::span<Out>(b->out.data(), n));
+
+            lock.lock();
+            b->result = std::move(s);
+            b->done = true;
+            b->cv.notify_all();
+        }
+        else {
+            b->cv.wait(lock, [&]() { return b->done; });
+        }
+
+        if (b->result) { return *b->result; }
+        return b->out[index];
+    }
+
+    template <typename K, typename In, typename Out, compute_mode M>
+    coalesce_stats coalescer<K, In, Out, M>::stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_stats;
+    }
+}
@@ -0,0 +1,415 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/avx_util.h"
+
+#include <gsl.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#if defined(kernelpp_WITH_AVX)
+#   include <immintrin.h>
+#endif
+
+/*  Lazy element-wise expressions over spans of floats. Arithmetic on
+ *  expressions builds a tree, which `expr::assign` evaluates with a
+ *  single fused loop per compute mode, without intermediate arrays:
+ *
+ *      using namespace kernelpp::expr;
+ *      status s = assign(z, exp(a * view(x) + b) * view(mask));
+ *
+ *  The tree holds pointers to its inputs, which must outlive it.
+ */
+namespace kernelpp { namespace expr
+{
+    /*  The size of an expression which broadcasts, i.e. a scalar */
+    constexpr size_t npos = size_t(-1);
+
+    /*  The size of an expression whose operands differ in size */
+    constexpr size_t mismatch = size_t(-2);
+
+    template <typename D>
+    struct node
+    {
+        const D& self() const { return static_cast<const D&>(*this); }
+    };
+
+    template <typename T>
+    using is_node = std::is_base_of<node<T>, T>;
+
+    /*  An input array */
+    struct terminal : node<terminal>
+    {
+        terminal(const float* data, size_t n) : data(data), n(n) {}
+
+        size_t size() const { return n; }
+        float eval(size_t i) const { return data[i]; }
+
+#if defined(kernelpp_WITH_AVX)
+        template <bool Tail>
+        kernelpp_AVX_FN __m256 eval8(size_t i, __m256i mask) const {
+            return Tail ? _mm256_maskload_ps(data + i, mask) : _mm256_loadu_ps(data + i);
+        }
+#endif
+        const float* data;
+        size_t n;
+    };
+
+    /*  A constant, broadcast to every element */
+    struct scalar : node<scalar>
+    {
+        explicit scalar(float v) : v(v) {}
+
+        size_t size() const { return npos; }
+        float eval(size_t) const { return v; }
+
+#if defined(kernelpp_WITH_AVX)
+        template <bool Tail>
+        kernelpp_AVX_FN __m256 eval8(size_t, __m256i) const { return _mm256_set1_ps(v); }
+#endif
+        float v;
+    };
+
+    template <typename Op, typename A>
+    struct unary : node<unary<Op, A>>
+    {
+        explicit unary(const A& a) : a(a) {}
+
+        size_t size() const { return a.size(); }
+        float eval(size_t i) const { return Op::apply(a.eval(i)); }
+
+#if defined(kernelpp_WITH_AVX)
+        template <bool Tail>
+        kernelpp_AVX_FN __m256 eval8(size_t i, __m256i mask) const {
+            return Op::apply(a.template eval8<Tail>(i, mask));
+        }
+#endif
+        A a;
+    };
+
+    namespace detail
+    {
+        inline size_t combine(size_t a, size_t b)
+        {
+            if (a == npos) { return b; }
+            if (b == npos) { return a; }
+            return a == b ? a : mismatch;
+        }
+    }
+
+    template <typename Op, typename A, typename B>
+    struct binary : node<binary<Op, A, B>>
+    {
+        binary(const A& a, const B& b) : a(a), b(b) {}
+
+        size_t size() const { return detail::combine(a.size(), b.size()); }
+        float eval(size_t i) const { return Op::apply(a.eval(i), b.eval(i)); }
+
+#if defined(kernelpp_WITH_AVX)
+        template <bool Tail>
+        kernelpp_AVX_FN __m256 eval8(size_t i, __m256i mask) const {
+            return Op::apply(a.template eval8<Tail>(i, mask), b.template eval8<Tail>(i, mask));
+        }
+#endif
+        A a;
+        B b;
+    };
+
+    /*  Elements of `a` where `c` is non-zero, otherwise of `b`. Both
+     *  branches are evaluated. */
+    template <typename C, typename A, typename B>
+    struct selection : node<selection<C, A, B>>
+    {
+        selection(const C& c, const A& a, const B& b) : c(c), a(a), b(b) {}
+
+        size_t size() const {
+            return detail::combine(c.size(), detail::combine(a.size(), b.size()));
+        }
+        float eval(size_t i) const { return c.eval(i) != 0.0f ? a.eval(i) : b.eval(i); }
+
+#if defined(kernelpp_WITH_AVX)
+        template <bool Tail>
+        kernelpp_AVX_FN __m256 eval8(size_t i, __m256i mask) const {
+            const __m256 m = _mm256_cmp_ps(
+                c.template eval8<Tail>(i, mask), _mm256_setzero_ps(), _CMP_NEQ_UQ);
+            return _mm256_blendv_ps(b.template eval8<Tail>(i, mask), a.template eval8<Tail>(i, mask), m);
+        }
+#endif
+        C c;
+        A a;
+        B b;
+    };
+
+
+    /*  Operations --------------------------------------------------------- */
+
+    namespace ops
+    {
+#if defined(kernelpp_WITH_AVX)
+#   define kernelpp_EXPR_OP(Name, ScalarExpr, AvxExpr)                               \
+        struct Name {                                                                \
+            static float apply(float a, float b) { return ScalarExpr; }              \
+            kernelpp_AVX_FN static __m256 apply(__m256 a, __m256 b) { return AvxExpr; } \
+        };
+#   define kernelpp_EXPR_UNARY_OP(Name, ScalarExpr, AvxExpr)                         \
+        struct Name {                                                                \
+            static float apply(float a) { return ScalarExpr; }                       \
+            kernelpp_AVX_FN static __m256 apply(__m256 a) { return AvxExpr; }        \
+        };
+#else
+#   define kernelpp_EXPR_OP(Name, ScalarExpr, AvxExpr)                               \
+        struct Name { static float apply(float a, float b) { return ScalarExpr; } };
+#   define kernelpp_EXPR_UNARY_OP(Name, ScalarExpr, AvxExpr)                         \
+        struct Name { static float apply(float a) { return ScalarExpr; } };
+#endif
+
+#if defined(kernelpp_WITH_AVX)
+        /*  Cephes-style expf: a degree 5 polynomial on the argument reduced
+         *  by multiples of ln(2), scaled by 2^n. Within 2 ulp of std::exp
+         *  for normal results; like std::exp, overflows to infinity above
+         *  about 88.72, is denormal below about -87.3, and passes NaN. */
+        kernelpp_AVX_FN inline __m256 exp_avx(__m256 x)
+        {
+            /* x second, so NaN passes through */
+            x = _mm256_min_ps(_mm256_set1_ps(89.0f), x);
+            x = _mm256_max_ps(_mm256_set1_ps(-104.0f), x);
+
+            __m256 fx = _mm256_add_ps(
+                _mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _mm256_set1_ps(0.5f));
+            fx = _mm256_floor_ps(fx);
+
+            x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(0.693359375f)));
+            x = _mm256_sub_ps(x, _mm256_mul_ps(fx, _mm256_set1_ps(-2.12194440e-4f)));
+
+            const __m256 z = _mm256_mul_ps(x, x);
+            __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.3981999507e-3f));
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(8.3334519073e-3f));
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(4.1665795894e-2f));
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(1.6666665459e-1f));
+            y = _mm256_add_ps(_mm256_mul_ps(y, x), _mm256_set1_ps(5.0000001201e-1f));
+            y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(y, z), x), _mm256_set1_ps(1.0f));
+
+            /* 2^n, built from the exponent bits in two halves so each is
+               a normal float for n in [-150, 128] */
+            const __m256i n = _mm256_cvttps_epi32(fx);
+            const __m256i n1 = _mm256_srai_epi32(n, 1);
+            const __m256i n2 = _mm256_sub_epi32(n, n1);
+            const __m256i bias = _mm256_set1_epi32(127);
+
+            const __m256 p1 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n1, bias), 23));
+            const __m256 p2 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n2, bias), 23));
+
+            return _mm256_mul_ps(_mm256_mul_ps(y, p1), p2);
+        }
+
+        kernelpp_AVX_FN inline __m256 bool_avx(__m256 m) {
+            return _mm256_and_ps(m, _mm256_set1_ps(1.0f));
+        }
+#endif
+
+        kernelpp_EXPR_OP(add, a + b, _mm256_add_ps(a, b))
+        kernelpp_EXPR_OP(sub, a - b, _mm256_sub_ps(a, b))
+        kernelpp_EXPR_OP(mul, a * b, _mm256_mul_ps(a, b))
+        kernelpp_EXPR_OP(div, a / b, _mm256_div_ps(a, b))
+        kernelpp_EXPR_OP(min, b < a ? b : a, _mm256_min_ps(b, a))
+        kernelpp_EXPR_OP(max, a < b ? b : a, _mm256_max_ps(b, a))
+
+        /* comparisons are 1 where true, 0 otherwise */
+        kernelpp_EXPR_OP(lt, a <  b ? 1.0f : 0.0f, bool_avx(_mm256_cmp_ps(a, b, _CMP_LT_OQ)))
+        kernelpp_EXPR_OP(gt, a >  b ? 1.0f : 0.0f, bool_avx(_mm256_cmp_ps(a, b, _CMP_GT_OQ)))
+        kernelpp_EXPR_OP(le, a <= b ? 1.0f : 0.0f, bool_avx(_mm256_cmp_ps(a, b, _CMP_LE_OQ)))
+        kernelpp_EXPR_OP(ge, a >= b ? 1.0f : 0.0f, bool_avx(_mm256_cmp_ps(a, b, _CMP_GE_OQ)))
+
+        kernelpp_EXPR_UNARY_OP(neg, -a, _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)))
+        kernelpp_EXPR_UNARY_OP(abs, std::fabs(a), _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a))
+        kernelpp_EXPR_UNARY_OP(sqrt, std::sqrt(a), _mm256_sqrt_ps(a))
+        kernelpp_EXPR_UNARY_OP(exp, std::exp(a), exp_avx(a))
+
+#undef kernelpp_EXPR_OP
+#undef kernelpp_EXPR_UNARY_OP
+    }
+
+
+    /*  Construction ------------------------------------------------------- */
+
+    inline terminal view(gsl::span<const float> x) { return terminal(x.data(), x.size()); }
+    inline terminal view(const std::vector<float>& x) { return terminal(x.data(), x.size()); }
+
+    namespace detail
+    {
+        template <typename T>
+        using is_operand = std::integral_constant<bool,
+            is_node<T>::value || std::is_arithmetic<T>::value>;
+
+        template <typename A, typename B>
+        using enable_binary = std::enable_if_t<
+            is_operand<A>::value && is_operand<B>::value &&
+            (is_node<A>::value || is_node<B>::value)>;
+
+        template <typename T>
+        using operand_t = std::conditional_t<is_node<T>::value, T, scalar>;
+
+        template <typename T>
+        std::enable_if_t<is_node<T>::value, const T&> wrap(const T& x) { return x; }
+
+        template <typename T>
+        std::enable_if_t<std::is_arithmetic<T>::value, scalar> wrap(T x) { return scalar(float(x)); }
+
+        template <typename Op, typename A, typename B>
+        binary<Op, operand_t<A>, operand_t<B>> make_binary(const A& a, const B& b) {
+            return binary<Op, operand_t<A>, operand_t<B>>(wrap(a), wrap(b));
+        }
+    }
+
+#define kernelpp_EXPR_BINARY_FN(Fn, Op)                                              \
+    template <typename A, typename B, typename = detail::enable_binary<A, B>>         \
+    binary<ops::Op, detail::operand_t<A>, detail::operand_t<B>> Fn(const A& a, const B& b) { \
+        return detail::make_binary<ops::Op>(a, b);                                    \
+    }
+
+    kernelpp_EXPR_BINARY_FN(operator+, add)
+    kernelpp_EXPR_BINARY_FN(operator-, sub)
+    kernelpp_EXPR_BINARY_FN(operator*, mul)
+    kernelpp_EXPR_BINARY_FN(operator/, div)
+    kernelpp_EXPR_BINARY_FN(operator<, lt)
+    kernelpp_EXPR_BINARY_FN(operator>, gt)
+    kernelpp_EXPR_BINARY_FN(operator<=, le)
+    kernelpp_EXPR_BINARY_FN(operator>=, ge)
+    kernelpp_EXPR_BINARY_FN(min, min)
+    kernelpp_EXPR_BINARY_FN(max, max)
+
+#undef kernelpp_EXPR_BINARY_FN
+
+#define kernelpp_EXPR_UNARY_FN(Fn, Op)                                               \
+    template <typename A, typename = std::enable_if_t<is_node<A>::value>>             \
+    unary<ops::Op, A> Fn(const A& a) { return unary<ops::Op, A>(a); }
+
+    kernelpp_EXPR_UNARY_FN(operator-, neg)
+    kernelpp_EXPR_UNARY_FN(abs, abs)
+    kernelpp_EXPR_UNARY_FN(sqrt, sqrt)
+    kernelpp_EXPR_UNARY_FN(exp, exp)
+
+#undef kernelpp_EXPR_UNARY_FN
+
+    template <typename C, typename A, typename B,
+              typename = std::enable_if_t<is_node<C>::value &&
+                  detail::is_operand<A>::value && detail::is_operand<B>::value>>
+    selection<C, detail::operand_t<A>, detail::operand_t<B>> select(const C& c, const A& a, const B& b)
+    {
+        return selection<C, detail::operand_t<A>, detail::operand_t<B>>(
+            c, detail::wrap(a), detail::wrap(b));
+    }
+
+
+    /*  Evaluation --------------------------------------------------------- */
+
+    namespace detail
+    {
+        template <compute_mode M> struct fused_loop;
+
+        template <> struct fused_loop<compute_mode::CPU>
+        {
+            template <typename E>
+            static void run(float* out, const E& e, size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++) { out[i] = e.eval(i); }
+            }
+        };
+
+#if defined(kernelpp_WITH_AVX)
+        template <> struct fused_loop<compute_mode::AVX>
+        {
+            template <typename E>
+            kernelpp_AVX_FN static void run(float* out, const E& e, size_t begin, size_t end)
+            {
+                const __m256i all = _mm256_set1_epi32(-1);
+                size_t i = begin;
+
+                for (; i + 8 <= end; i += 8) {
+                    _mm256_storeu_ps(out + i, e.template eval8<false>(i, all));
+                }
+                if (i < end) {
+                    const __m256i mask = _mm256_cmpgt_epi32(
+                        _mm256_set1_epi32(int(end - i)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+                    _mm256_maskstore_ps(out + i, mask, e.template eval8<true>(i, mask));
+                }
+            }
+        };
+#endif
+
+        /*  Evaluates elements [begin, end) of an expression in to `out` */
+        KERNEL_DECL(fused_assign, compute_mode::CPU, compute_mode::AVX)
+        {
+            template <compute_mode M, typename E>
+            static void op(float* out, const E& e, size_t begin, size_t end) {
+                fused_loop<M>::run(out, e, begin, end);
+            }
+        };
+    }
+
+    /*  Evaluates `e` in to `out` in a single pass. `out` may alias an
+     *  input of `e`, as each element is read before it is written. With
+     *  `threads` > 1, contiguous chunks are evaluated concurrently.
+     */
+    template <compute_mode M = compute_mode::AUTO, typename E>
+    status assign(gsl::span<float> out, const node<E>& expression, size_t threads = 1)
+    {
+        const E& e = expression.self();
+        const size_t n = e.size();
+
+        if (n == mismatch) {
+            return status{ "expression operands differ in size" };
+        }
+        if (n != npos && n != size_t(out.size())) {
+            return status{ "expression and output differ in size" };
+        }
+
+        const size_t len = out.size();
+        if (threads <= 1 || len < threads * 8) {
+            return kernelpp::run<detail::fused_assign, M>(out.data(), e, size_t(0), len);
+        }
+
+        /* chunks are whole vectors, so only the last has a tail */
+        const size_t chunk = ((len + threads - 1) / threads + 7) / 8 * 8;
+
+        std::vector<status> results(threads);
+        std::vector<std::thread> workers;
+
+        for (size_t t = 0; t < threads && t * chunk < len; t++) {
+            const size_t begin = t * chunk;
+            const size_t end = std::min(len, begin + chunk);
+
+            workers.emplace_back([&results, &e, &out, t, begin, end]() {
+                results[t] = kernelpp::run<detail::fused_assign, M>(out.data(), e, begin, end);
+            });
+        }
+        for (auto& w : workers) { w.join(); }
+
+        for (status& s : results) {
+            if (s) { return s; }
+        }
+        return status();
+    }
+}}
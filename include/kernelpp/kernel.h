@@ -55,6 +55,29 @@ namespace kernelpp
     inline const char* to_str(const compute_mode m);
 
 
+    /*  static mode -------------------------------------------------------- */
+
+#if defined(kernelpp_STATIC_MODE)
+    /*  The compute mode targeted by this build. When defined, AUTO is
+        resolved at compile-time to this mode (or CPU where a kernel
+        doesn't support it), and the mode is assumed to be available. */
+    constexpr compute_mode static_mode = compute_mode::kernelpp_STATIC_MODE;
+#endif
+
+    namespace detail
+    {
+        template <compute_mode M>
+        constexpr bool is_static_mode()
+        {
+#if defined(kernelpp_STATIC_MODE)
+            return M == static_mode;
+#else
+            return false;
+#endif
+        }
+    }
+
+
     /*  compute_traits ----------------------------------------------------- */
 
     template <compute_mode>
@@ -73,7 +96,9 @@ namespace kernelpp
     template <>
     struct compute_traits<compute_mode::AVX> {
         static constexpr bool enabled = true;
-        static bool available() { return kernelpp::init_avx(); }
+        static bool available() {
+            return detail::is_static_mode<compute_mode::AVX>() || kernelpp::init_avx();
+        }
     };
 #endif
 
@@ -81,7 +106,9 @@ namespace kernelpp
     template <>
     struct compute_traits<compute_mode::CUDA> {
         static constexpr bool enabled = true;
-        static bool available() { return kernelpp::init_cudart(); }
+        static bool available() {
+            return detail::is_static_mode<compute_mode::CUDA>() || kernelpp::init_cudart();
+        }
     };
 #endif
 
@@ -129,6 +129,32 @@ namespace kernelpp
         }
     };
 
+#if defined(kernelpp_STATIC_MODE)
+
+    namespace detail
+    {
+        /*  Resolves AUTO for kernel `K` at compile-time: the static mode
+            if the kernel supports it, otherwise CPU. */
+        template <typename K>
+        struct static_resolve
+        {
+            static constexpr compute_mode value =
+                K::template supports<static_mode>::value ? static_mode : compute_mode::CPU;
+        };
+    }
+
+    /*  Specialization for AUTO: determines compute_mode at compile-time  */
+    template <>
+    template <typename Kernel, typename Runner, typename... Args>
+    auto control<compute_mode::AUTO>::call(Runner& r, Args&&... args)
+        -> result<Kernel, Args...>
+    {
+        return control<detail::static_resolve<Kernel>::value>::template call<Kernel>(
+                r, std::forward<Args>(args)...);
+    }
+
+#else
+
     /*  Specialization for AUTO: determines compute_mode at runtime  */
     template <>
     template <typename Kernel, typename Runner, typename... Args>
@@ -153,6 +179,8 @@ namespace kernelpp
         return s;
     }
 
+#endif
+
 
     /*  kernel runner ------------------------------------------------------ */
 
@@ -217,6 +245,13 @@ namespace kernelpp
         inline status convert(error_code r) {
             return r == error_code::NONE ? status() : status{ to_str(r) };
         }
+
+        inline status to_status(status s) { return s; }
+
+        template <typename R>
+        status to_status(const maybe<R>& r) {
+            return r.template is<error>() ? status{ r.template get<error>() } : status();
+        }
     }
 
     template <
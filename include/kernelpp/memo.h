@@ -0,0 +1,231 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <gsl.h>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+
+namespace kernelpp
+{
+    /*  Opts a kernel in to memoization. Specialize this for kernels whose
+     *  result depends only on the contents of their arguments:
+     *
+     *      template <> struct is_pure<my_kernel> : std::true_type {};
+     */
+    template <typename K>
+    struct is_pure : std::false_type {};
+
+    /*  64-bit non-cryptographic hash of a byte range. The CPU and AVX
+     *  implementations produce identical results.
+     */
+    KERNEL_DECL(hash_bytes, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static uint64_t op(const void* data, size_t len, uint64_t seed);
+    };
+
+    template <> uint64_t hash_bytes::op<compute_mode::CPU>(const void*, size_t, uint64_t);
+    template <> uint64_t hash_bytes::op<compute_mode::AVX>(const void*, size_t, uint64_t);
+
+    /*  `memo_hash<T>` hashes a kernel argument of type `T`. Spans and
+     *  vectors are hashed by content, or by address and length when
+     *  `by_address` is set. Specialize it for other argument types.
+     */
+    template <typename T, typename = void>
+    struct memo_hash;
+
+    struct memo_stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t entries = 0;
+
+        /* lookups whose key matched an entry with a different check */
+        size_t collisions = 0;
+    };
+
+    /*  `memo_cache` is a thread-safe, size-bounded cache of kernel
+     *  results. Entries are spread over a number of shards, each with
+     *  its own lock and least-recently-used eviction. Each entry carries
+     *  a `check` value, typically a second hash of the arguments, which
+     *  must also match for a lookup to hit.
+     */
+    class memo_cache final
+    {
+        struct shard;
+        std::unique_ptr<shard[]> m_shards;
+        size_t m_num_shards;
+
+      public:
+        /*  `capacity` is the maximum number of entries, over all shards */
+        explicit memo_cache(size_t capacity = 4096, size_t shards = 16);
+        ~memo_cache();
+
+        std::shared_ptr<const void> find(uint64_t key, uint64_t check = 0);
+        void insert(uint64_t key, std::shared_ptr<const void> value, uint64_t check = 0);
+
+        void invalidate(uint64_t key);
+        void clear();
+
+        memo_stats stats() const;
+    };
+
+    /*  `memo_runner<K>` returns cached results for repeated invocations
+     *  of the pure kernel `K` with identical arguments. Only successful
+     *  results are cached. Entries are keyed on a 64-bit hash of the
+     *  kernel name, compute mode and arguments, and verified on a hit
+     *  with a second, independently seeded hash.
+     *
+     *  Only kernels which return their result are eligible; kernels
+     *  returning `void` or `error_code` produce their output through
+     *  their arguments, which a hit would leave unwritten.
+     */
+    template <typename K>
+    struct memo_runner : public runner<K>
+    {
+        static_assert(is_pure<K>::value,
+            "memo_runner requires a kernel marked with is_pure<K>");
+
+        using typename runner<K>::traits;
+
+        memo_runner(memo_cache* cache, bool by_address = false)
+            : m_cache(cache), m_by_address(by_address)
+        {}
+
+        template <compute_mode M, typename... Args>
+        auto apply(Args&&... args) -> result<K, Args...>;
+
+        /*  The cache key of an invocation with the given arguments */
+        template <compute_mode M, typename... Args>
+        uint64_t key(const Args&... args) const { return hash_args<M>(0, args...); }
+
+      private:
+        static constexpr uint64_t check_seed = 0x2545f4914f6cdd1dull;
+
+        template <compute_mode M, typename... Args>
+        uint64_t hash_args(uint64_t seed, const Args&... args) const;
+
+        memo_cache* m_cache;
+        bool m_by_address;
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    namespace detail
+    {
+        inline uint64_t hash(const void* data, size_t len, uint64_t seed)
+        {
+            auto h = run<hash_bytes>(data, len, seed);
+            return h.template is<uint64_t>() ? h.template get<uint64_t>() : 0;
+        }
+
+        template <typename T>
+        uint64_t hash_value(const T& v, uint64_t seed)
+        {
+            return hash(&v, sizeof(T), seed);
+        }
+    }
+
+    template <typename T>
+    struct memo_hash<T, std::enable_if_t<
+        std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value
+        >>
+    {
+        static uint64_t apply(const T& v, uint64_t seed, bool) {
+            return detail::hash_value(v, seed);
+        }
+    };
+
+    template <typename T>
+    struct memo_hash<gsl::span<T>>
+    {
+        static_assert(std::is_trivially_copyable<std::remove_cv_t<T>>::value,
+            "memo_hash requires a trivially copyable element type");
+
+        static uint64_t apply(const gsl::span<T>& v, uint64_t seed, bool by_address)
+        {
+            const size_t n = v.size();
+            seed = detail::hash_value(n, seed);
+
+            if (by_address) { return detail::hash_value(v.data(), seed); }
+            return detail::hash(v.data(), n * sizeof(T), seed);
+        }
+    };
+
+    template <typename T>
+    struct memo_hash<std::vector<T>>
+    {
+        static uint64_t apply(const std::vector<T>& v, uint64_t seed, bool by_address) {
+            return memo_hash<gsl::span<const T>>::apply(
+                gsl::span<const T>(v.data(), v.size()), seed, by_address);
+        }
+    };
+
+    template <typename K>
+    template <compute_mode M, typename... Args>
+    uint64_t memo_runner<K>::hash_args(uint64_t seed, const Args&... args) const
+    {
+        const char* name = traits::name;
+        uint64_t h = detail::hash(name, std::strlen(name), seed);
+
+        h = detail::hash_value(M, h);
+        h = detail::hash_value(typeid(result<K, Args...>).hash_code(), h);
+
+        (void) std::initializer_list<int>{
+            (h = memo_hash<std::decay_t<Args>>::apply(args, h, m_by_address), 0)...
+        };
+        return h;
+    }
+
+    template <typename K>
+    template <compute_mode M, typename... Args>
+    auto memo_runner<K>::apply(Args&&... args) -> result<K, Args...>
+    {
+        using R = result<K, Args...>;
+
+        static_assert(!std::is_same<R, error_code>::value,
+            "memo_runner requires a kernel which returns its result");
+
+        /* kernels which don't support M are never cached */
+        if (!K::template supports<M>::value) {
+            return runner<K>::template apply<M>(std::forward<Args>(args)...);
+        }
+
+        const uint64_t k = key<M>(args...);
+        const uint64_t check = hash_args<M>(check_seed, args...);
+
+        if (std::shared_ptr<const void> hit = m_cache->find(k, check)) {
+            return *static_cast<const R*>(hit.get());
+        }
+
+        R r = runner<K>::template apply<M>(std::forward<Args>(args)...);
+
+        if (op_traits<K, Args...>::get_errc(r) == error_code::NONE) {
+            m_cache->insert(k, std::make_shared<R>(r), check);
+        }
+        return r;
+    }
+}
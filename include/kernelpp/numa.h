@@ -0,0 +1,311 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <gsl.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace kernelpp
+{
+    struct numa_node
+    {
+        /* the OS node id, as reported by `memory_node` */
+        int id;
+
+        /* the cpus of the node the process may run on */
+        std::vector<int> cpus;
+    };
+
+    /*  The NUMA nodes of the host, restricted to the cpus in the affinity
+     *  mask of the process. Nodes without any such cpus are omitted.
+     */
+    class numa_topology final
+    {
+        std::vector<numa_node> m_nodes;
+        bool m_simulated = false;
+
+      public:
+        /*  Reads the topology from /sys/devices/system/node. Hosts without
+         *  NUMA support are described as a single node.
+         */
+        static numa_topology discover();
+
+        /*  A topology of `nodes` nodes with `cpus` cpus each, for testing
+         *  on single node hosts. Workers of a simulated topology are not
+         *  pinned, and memory is not placed.
+         */
+        static numa_topology simulated(size_t nodes, size_t cpus);
+
+        size_t size() const { return m_nodes.size(); }
+        const numa_node& node(size_t i) const { return m_nodes[i]; }
+        bool is_simulated() const { return m_simulated; }
+
+        /*  The index of the node containing `cpu`, or -1 */
+        int node_of_cpu(int cpu) const;
+    };
+
+    /*  The OS id of the node holding the page at `p`, or -1 if the page
+     *  isn't resident or the host doesn't report placement.
+     */
+    int memory_node(const void* p);
+
+    /*  Where tasks ran relative to the node owning their data */
+    struct numa_stats
+    {
+        size_t local_tasks = 0;
+        size_t remote_tasks = 0;
+        size_t local_bytes = 0;
+        size_t remote_bytes = 0;
+
+        double local_ratio() const {
+            const size_t n = local_bytes + remote_bytes;
+            return n ? double(local_bytes) / n : 1.0;
+        }
+    };
+
+    template <typename T> class numa_array;
+
+    /*  `numa_pool` runs tasks on worker threads grouped by NUMA node, with
+     *  each group pinned to the cpus of its node. A task is submitted to
+     *  the node owning its data; when `steal` is set, idle workers of
+     *  other nodes may run it remotely rather than wait.
+     */
+    class numa_pool final
+    {
+        struct impl;
+        struct impl_deleter { void operator()(impl*) const; };
+        std::unique_ptr<impl, impl_deleter> m_impl;
+
+      public:
+        /*  `workers` is the number of workers per node, or 0 for one per cpu */
+        explicit numa_pool(numa_topology topology, size_t workers = 0, bool steal = true);
+        ~numa_pool();
+
+        const numa_topology& topology() const;
+        size_t workers(size_t node) const;
+
+        /*  Queues `task` on `node`. `bytes` is the amount of node-local
+         *  data the task accesses, for the purpose of `stats()`.
+         */
+        void submit(size_t node, std::function<void()> task, size_t bytes = 0);
+
+        /*  Blocks until all submitted tasks have completed */
+        void wait();
+
+        /*  The node of the calling worker thread, or -1 */
+        static int current_node();
+
+        /*  Allocates `n` elements spread evenly across the nodes, each
+         *  part zeroed by a worker of its node so that its pages are
+         *  placed there on first touch. These tasks are never stolen.
+         *  Fails, having released any parts already reserved, if a part
+         *  can't be reserved.
+         */
+        template <typename T>
+        maybe<numa_array<T>> allocate(size_t n);
+
+        /*  Invokes `K` on each chunk of `a` on the node which owns it as
+         *
+         *      run<K, M>(gsl::span<T> chunk, args...)
+         *
+         *  Each part is split in to one chunk per worker of its node.
+         *  Returns the first error, if any.
+         */
+        template <typename K, compute_mode M = compute_mode::AUTO, typename T, typename... Args>
+        status run(numa_array<T>& a, const Args&... args);
+
+        numa_stats stats() const;
+        void reset_stats();
+
+      private:
+        /*  Queues `task` to run on `node` only, without counting it in
+         *  `stats()`; used to place memory by first touch. */
+        void place(size_t node, std::function<void()> task);
+    };
+
+    namespace detail
+    {
+        /*  Reserves page-aligned memory which is not yet backed by pages */
+        void* numa_reserve(size_t bytes);
+        void  numa_release(void* p, size_t bytes);
+    }
+
+    /*  An array of `T` divided in to one contiguous part per NUMA node */
+    template <typename T>
+    class numa_array final
+    {
+        static_assert(std::is_trivial<T>::value,
+            "numa_array requires a trivial element type");
+
+        struct part {
+            size_t node;
+            T* data;
+            size_t size;
+        };
+
+        std::vector<part> m_parts;
+        size_t m_size = 0;
+
+        friend class numa_pool;
+
+      public:
+        numa_array() = default;
+        numa_array(numa_array&& other);
+        numa_array& operator=(numa_array&& other);
+        ~numa_array();
+
+        size_t size() const { return m_size; }
+        size_t parts() const { return m_parts.size(); }
+
+        gsl::span<T> part_span(size_t i) const { return gsl::span<T>(m_parts[i].data, m_parts[i].size); }
+        size_t owner(size_t i) const { return m_parts[i].node; }
+
+        T& operator[](size_t i);
+        const T& operator[](size_t i) const;
+
+      private:
+        void release();
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    template <typename T>
+    numa_array<T>::numa_array(numa_array&& other)
+        : m_parts(std::move(other.m_parts)), m_size(other.m_size)
+    {
+        other.m_parts.clear();
+        other.m_size = 0;
+    }
+
+    template <typename T>
+    numa_array<T>& numa_array<T>::operator=(numa_array&& other)
+    {
+        if (this != &other) {
+            release();
+            m_parts = std::move(other.m_parts);
+            m_size = other.m_size;
+
+            other.m_parts.clear();
+            other.m_size = 0;
+        }
+        return *this;
+    }
+
+    template <typename T>
+    numa_array<T>::~numa_array() { release(); }
+
+    template <typename T>
+    void numa_array<T>::release()
+    {
+        for (part& p : m_parts) { detail::numa_release(p.data, p.size * sizeof(T)); }
+        m_parts.clear();
+        m_size = 0;
+    }
+
+    template <typename T>
+    T& numa_array<T>::operator[](size_t i)
+    {
+        size_t p = 0;
+        while (i >= m_parts[p].size) { i -= m_parts[p++].size; }
+        return m_parts[p].data[i];
+    }
+
+    template <typename T>
+    const T& numa_array<T>::operator[](size_t i) const
+    {
+        return const_cast<numa_array&>(*this)[i];
+    }
+
+    template <typename T>
+    maybe<numa_array<T>> numa_pool::allocate(size_t n)
+    {
+        const size_t nodes = topology().size();
+        numa_array<T> a;
+
+        /* reserve every part before touching any, so a failure leaves
+           nothing queued and `a` releases what was reserved */
+        for (size_t i = 0; i < nodes; i++) {
+            const size_t len = n / nodes + (i < n % nodes ? 1 : 0);
+            if (len == 0) { continue; }
+
+            T* data = len <= SIZE_MAX / sizeof(T)
+                ? static_cast<T*>(detail::numa_reserve(len * sizeof(T))) : nullptr;
+            if (!data) {
+                return error("failed to reserve " + std::to_string(len * sizeof(T)) +
+                             " bytes for node " + std::to_string(i));
+            }
+            a.m_parts.push_back({ i, data, len });
+        }
+
+        for (const auto& p : a.m_parts) {
+            T* data = p.data;
+            const size_t len = p.size;
+            place(p.node, [data, len]() { std::memset(data, 0, len * sizeof(T)); });
+        }
+
+        a.m_size = n;
+        wait();
+
+        return a;
+    }
+
+    template <typename K, compute_mode M, typename T, typename... Args>
+    status numa_pool::run(numa_array<T>& a, const Args&... args)
+    {
+        std::mutex mtx;
+        status first;
+
+        for (size_t p = 0; p < a.parts(); p++)
+        {
+            const size_t node = a.owner(p);
+            const gsl::span<T> part = a.part_span(p);
+
+            const size_t chunks = workers(node);
+            const size_t len = (part.size() + chunks - 1) / chunks;
+
+            for (size_t begin = 0; begin < size_t(part.size()); begin += len)
+            {
+                const gsl::span<T> chunk = part.subspan(begin, std::min(len, size_t(part.size()) - begin));
+
+                submit(node, [&mtx, &first, chunk, &args...]() {
+                    status s = detail::to_status(kernelpp::run<K, M>(chunk, args...));
+
+                    if (s) {
+                        std::lock_guard<std::mutex> lock(mtx);
+                        if (!first) { first = std::move(s); }
+                    }
+                }, chunk.size() * sizeof(T));
+            }
+        }
+
+        wait();
+        return first;
+    }
+}
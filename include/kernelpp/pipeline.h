@@ -0,0 +1,437 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace kernelpp
+{
+    /*  `bounded_queue<T>` is a fixed capacity, lock-free multi-producer
+     *  multi-consumer queue. The blocking `push` and `pop` spin (and
+     *  eventually sleep) while the queue is full or empty, which is how
+     *  back-pressure propagates through a `pipeline`.
+     */
+    template <typename T>
+    class bounded_queue final
+    {
+        struct cell {
+            std::atomic<size_t> seq;
+            T value;
+        };
+
+        std::unique_ptr<cell[]> m_cells;
+        size_t m_mask;
+
+        /* keep the producer and consumer positions on separate lines */
+        char m_pad0[64];
+        std::atomic<size_t> m_tail;
+        char m_pad1[64];
+        std::atomic<size_t> m_head;
+        char m_pad2[64];
+        std::atomic<bool> m_closed;
+
+      public:
+        /*  `capacity` is rounded up to a power of two */
+        explicit bounded_queue(size_t capacity);
+
+        /*  Non-blocking; `v` is moved from on success only */
+        bool try_push(T& v);
+        bool try_pop(T& v);
+
+        /*  Blocks until there is space, returns false if the queue is closed */
+        bool push(T v);
+
+        /*  Blocks until an element is available, returns false once the
+         *  queue is closed and empty
+         */
+        bool pop(T& v);
+
+        /*  Signals no more elements will be pushed */
+        void close();
+
+        size_t size() const;
+        size_t capacity() const { return m_mask + 1; }
+    };
+
+    /*  Statistics gathered for each stage of a `pipeline` */
+    struct stage_stats
+    {
+        const char* name = nullptr;
+        compute_mode mode = compute_mode::AUTO;
+        size_t workers = 0;
+
+        size_t blocks = 0;
+
+        /* time spent in the kernel, summed over all workers */
+        double busy_seconds = 0;
+
+        /* mean number of blocks waiting in the stage's input queue */
+        double mean_occupancy = 0;
+
+        /* fraction of the pipeline's run time the workers were busy */
+        double utilization(double seconds) const {
+            return seconds > 0 && workers > 0 ? busy_seconds / (seconds * workers) : 0;
+        }
+    };
+
+    /*  `pipeline<T>` runs a linear chain of kernels over a stream of blocks
+     *  of `T`. Each stage has its own compute mode and number of workers,
+     *  and stages are linked by `bounded_queue`s. Blocks are recycled
+     *  through a fixed pool, so the steady state doesn't allocate as long
+     *  as block sizes are stable. Each stage is invoked as
+     *
+     *      run<K, M>(std::vector<T>& block)
+     *
+     *  and transforms the block in-place (it may be resized).
+     */
+    template <typename T>
+    class pipeline final
+    {
+        struct stage_impl
+        {
+            std::function<status(std::vector<T>&)> fn;
+            stage_stats stats;
+        };
+
+        struct block
+        {
+            size_t seq;
+            std::vector<T> data;
+        };
+
+        std::vector<stage_impl> m_stages;
+        size_t m_depth;
+        bool m_ordered;
+        double m_seconds = 0;
+
+      public:
+        /*  `depth` is the capacity of the queue in front of each stage.
+         *  When `ordered` is true, blocks reach the sink in the order
+         *  the source produced them.
+         */
+        explicit pipeline(size_t depth = 8, bool ordered = true);
+
+        /*  Appends a stage which runs the kernel `K` with `workers`
+         *  threads.
+         */
+        template <typename K, compute_mode M = compute_mode::AUTO>
+        pipeline& stage(size_t workers = 1);
+
+        /*  Runs the pipeline to completion, or until a stage fails. The
+         *  source is called as `bool src(std::vector<T>&)` on a separate
+         *  thread, and returns false when there are no more blocks. The
+         *  sink is called as `void sink(std::vector<T>&)` on the calling
+         *  thread.
+         */
+        template <typename Source, typename Sink>
+        status run(Source src, Sink sink);
+
+        std::vector<stage_stats> stats() const;
+
+        /* duration of the most recent run */
+        double seconds() const { return m_seconds; }
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    namespace detail
+    {
+        /* spin, then yield, then sleep */
+        struct backoff
+        {
+            unsigned n = 0;
+
+            void operator()() {
+                if (++n < 16) { return; }
+                if (n < 64) { std::this_thread::yield(); return; }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        };
+    }
+
+    template <typename T>
+    bounded_queue<T>::bounded_queue(size_t capacity)
+        : m_tail{ 0 }, m_head{ 0 }, m_closed{ false }
+    {
+        size_t n = 2;
+        while (n < capacity) { n <<= 1; }
+
+        m_cells.reset(new cell[n]);
+        m_mask = n - 1;
+
+        for (size_t i = 0; i < n; i++) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    template <typename T>
+    bool bounded_queue<T>::try_push(T& v)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = m_cells[pos & m_mask];
+            const size_t seq = c.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    c.value = std::move(v);
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) { return false; }
+            else { pos = m_tail.load(std::memory_order_relaxed); }
+        }
+    }
+
+    template <typename T>
+    bool bounded_queue<T>::try_pop(T& v)
+    {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            cell& c = m_cells[pos & m_mask];
+            const size_t seq = c.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    v = std::move(c.value);
+                    c.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) { return false; }
+            else { pos = m_head.load(std::memory_order_relaxed); }
+        }
+    }
+
+    template <typename T>
+    bool bounded_queue<T>::push(T v)
+    {
+        detail::backoff wait;
+        while (!try_push(v)) {
+            if (m_closed.load(std::memory_order_acquire)) { return false; }
+            wait();
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool bounded_queue<T>::pop(T& v)
+    {
+        detail::backoff wait;
+        while (!try_pop(v)) {
+            /* elements pushed before close() are still delivered */
+            if (m_closed.load(std::memory_order_acquire)) { return try_pop(v); }
+            wait();
+        }
+        return true;
+    }
+
+    template <typename T>
+    void bounded_queue<T>::close() {
+        m_closed.store(true, std::memory_order_release);
+    }
+
+    template <typename T>
+    size_t bounded_queue<T>::size() const
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+
+    template <typename T>
+    pipeline<T>::pipeline(size_t depth, bool ordered)
+        : m_depth{ depth > 0 ? depth : 1 }, m_ordered{ ordered }
+    {}
+
+    template <typename T>
+    template <typename K, compute_mode M>
+    pipeline<T>& pipeline<T>::stage(size_t workers)
+    {
+        stage_impl s;
+        s.fn = [](std::vector<T>& data) {
+            return detail::to_status(kernelpp::run<K, M>(data));
+        };
+        s.stats.name = K::traits::name;
+        s.stats.mode = M;
+        s.stats.workers = workers > 0 ? workers : 1;
+
+        m_stages.push_back(std::move(s));
+        return *this;
+    }
+
+    template <typename T>
+    std::vector<stage_stats> pipeline<T>::stats() const
+    {
+        std::vector<stage_stats> out;
+        for (const stage_impl& s : m_stages) { out.push_back(s.stats); }
+        return out;
+    }
+
+    template <typename T>
+    template <typename Source, typename Sink>
+    status pipeline<T>::run(Source src, Sink sink)
+    {
+        using clock = std::chrono::steady_clock;
+        using seconds = std::chrono::duration<double>;
+
+        const auto t0 = clock::now();
+        const size_t n = m_stages.size();
+
+        /* every block which can be in flight at once */
+        size_t pool_size = m_depth * (n + 1);
+        for (const stage_impl& s : m_stages) { pool_size += s.stats.workers; }
+
+        std::vector<block> storage(pool_size);
+        bounded_queue<block*> pool(pool_size);
+
+        for (block& b : storage) {
+            block* p = &b;
+            pool.try_push(p);
+        }
+
+        /* queues[i] is the input to stage i, queues[n] the input to the sink */
+        std::vector<std::unique_ptr<bounded_queue<block*>>> queues;
+        for (size_t i = 0; i <= n; i++) {
+            queues.emplace_back(new bounded_queue<block*>(m_depth));
+        }
+
+        std::atomic<bool> cancelled{ false };
+        std::mutex mtx;
+        status err;
+
+        auto fail = [&](status s) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!err) { err = s; }
+            cancelled.store(true);
+        };
+
+        std::vector<std::thread> threads;
+
+        /* source */
+        threads.emplace_back([&]() {
+            for (size_t seq = 0; !cancelled.load(); seq++) {
+                block* b;
+                if (!pool.pop(b)) { break; }
+
+                b->seq = seq;
+                if (cancelled.load() || !src(b->data)) {
+                    pool.try_push(b);
+                    break;
+                }
+                queues[0]->push(b);
+            }
+            queues[0]->close();
+        });
+
+        /* stages */
+        std::unique_ptr<std::atomic<size_t>[]> running(new std::atomic<size_t>[n]);
+        std::vector<size_t> popped_total(n, 0);
+
+        for (size_t i = 0; i < n; i++) {
+            stage_impl& s = m_stages[i];
+            s.stats.blocks = 0;
+            s.stats.busy_seconds = 0;
+            s.stats.mean_occupancy = 0;
+
+            running[i].store(s.stats.workers);
+
+            for (size_t w = 0; w < s.stats.workers; w++) {
+                threads.emplace_back([&, i]() {
+                    stage_impl& s = m_stages[i];
+                    bounded_queue<block*>& in = *queues[i];
+
+                    size_t blocks = 0, popped = 0, occupancy = 0;
+                    double busy = 0;
+
+                    for (block* b; in.pop(b);) {
+                        occupancy += in.size();
+                        popped++;
+
+                        if (!cancelled.load()) {
+                            const auto k0 = clock::now();
+                            status r = s.fn(b->data);
+                            busy += seconds(clock::now() - k0).count();
+                            blocks++;
+
+                            if (r) { fail(r); }
+                        }
+                        queues[i + 1]->push(b);
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(mtx);
+                        s.stats.blocks += blocks;
+                        s.stats.busy_seconds += busy;
+                        s.stats.mean_occupancy += occupancy;
+                        popped_total[i] += popped;
+                    }
+
+                    /* the last worker out closes the next queue */
+                    if (running[i].fetch_sub(1) == 1) { queues[i + 1]->close(); }
+                });
+            }
+        }
+
+        /* sink; out of order blocks are held until their turn */
+        std::vector<block*> pending(pool_size, nullptr);
+        size_t next = 0;
+
+        auto consume = [&](block* b) {
+            if (!cancelled.load()) { sink(b->data); }
+            pool.try_push(b);
+        };
+
+        for (block* b; queues[n]->pop(b);) {
+            if (!m_ordered) {
+                consume(b);
+                continue;
+            }
+
+            pending[b->seq % pool_size] = b;
+            while (block* p = pending[next % pool_size]) {
+                pending[next % pool_size] = nullptr;
+                next++;
+                consume(p);
+            }
+        }
+
+        for (std::thread& t : threads) { t.join(); }
+
+        for (size_t i = 0; i < n; i++) {
+            stage_stats& s = m_stages[i].stats;
+            s.mean_occupancy = popped_total[i] > 0 ? s.mean_occupancy / popped_total[i] : 0;
+        }
+
+        m_seconds = seconds(clock::now() - t0).count();
+        return err;
+    }
+}
@@ -0,0 +1,219 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/avx_util.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#if defined(_WIN32)
+#   define kernelpp_PLUGIN_EXPORT extern "C" __declspec(dllexport)
+#else
+#   define kernelpp_PLUGIN_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+/*  Defines the entry points of a kernel plugin, a shared object which
+ *  registers additional kernel implementations when loaded with
+ *  `kernel_registry::load_plugin`. `Isa` is the combination of `isa`
+ *  flags the plugin as a whole requires:
+ *
+ *      kernelpp_PLUGIN(kernelpp::isa::AVX512F)
+ *      {
+ *          registry.add<saxpy>(&saxpy_avx512, compute_mode::AVX, kernelpp::isa::AVX512F);
+ *      }
+ */
+#define kernelpp_PLUGIN(Isa) \
+    kernelpp_PLUGIN_EXPORT uint32_t kernelpp_plugin_isa() { return (Isa); }      \
+    kernelpp_PLUGIN_EXPORT void kernelpp_plugin_register(::kernelpp::kernel_registry& registry)
+
+namespace kernelpp
+{
+    /*  A type-erased kernel implementation */
+    struct kernel_impl
+    {
+        std::string kernel;     /* the kernel's traits::name */
+        std::string signature;  /* typeid(Sig).name() of the function type */
+        compute_mode mode;
+        uint32_t required_isa;  /* isa flags */
+        int priority;
+        void (*fn)();
+    };
+
+    /*  `kernel_registry` holds implementations of kernels which are
+     *  provided at runtime, keyed by kernel name, function signature and
+     *  compute mode.
+     *
+     *  Implementations are added during startup, and take effect once
+     *  `publish()` is called. Publishing selects, for each key, the
+     *  highest priority implementation whose isa requirements are met by
+     *  the host. Lookups read the published snapshot without locking.
+     */
+    class kernel_registry final
+    {
+        struct snapshot;
+
+        mutable std::mutex m_mtx;
+        std::vector<kernel_impl> m_impls;
+        std::vector<std::unique_ptr<const snapshot>> m_snapshots;
+        std::atomic<const snapshot*> m_current;
+        std::atomic<uint64_t> m_generation;
+        uint32_t m_features;
+
+      public:
+        /*  `features` are the isa flags of the host */
+        explicit kernel_registry(uint32_t features = cpu_features());
+        ~kernel_registry();
+
+        /*  The process-wide registry */
+        static kernel_registry& instance();
+
+        /*  Adds an implementation of the kernel named `name` */
+        template <typename Sig>
+        void add(const char* name, Sig* fn, compute_mode m, uint32_t required_isa = 0, int priority = 0);
+
+        /*  Adds an implementation of `K`, with the signature `K::signature` */
+        template <typename K>
+        void add(typename K::signature* fn, compute_mode m, uint32_t required_isa = 0, int priority = 0);
+
+        void add(kernel_impl impl);
+
+        /*  Loads the plugin at `path`, and registers its implementations
+         *  if the host supports the plugin's isa requirements.
+         */
+        status load_plugin(const char* path);
+
+        /*  Makes all implementations added so far visible to lookups */
+        void publish();
+
+        /*  Lock-free lookup of the best implementation, or nullptr */
+        template <typename Sig>
+        Sig* find(const char* name, compute_mode m) const;
+
+        const kernel_impl* find(const char* name, const char* signature, compute_mode m) const;
+
+        /*  Identifies the published snapshot; changes on each publish() */
+        uint64_t generation() const { return m_generation.load(std::memory_order_acquire); }
+
+        uint32_t features() const { return m_features; }
+    };
+
+    /*  `registry_runner<K>` prefers an implementation of `K` from a
+     *  `kernel_registry` over the kernel's own `op<M>`. Registered
+     *  implementations are called with the signature `Sig`, which
+     *  defaults to `K::signature`. A registered implementation can
+     *  provide a compute mode the kernel itself doesn't support.
+     */
+    template <typename K, typename Sig = typename K::signature>
+    struct registry_runner : public runner<K>
+    {
+        using typename runner<K>::traits;
+
+        registry_runner(const kernel_registry* r = &kernel_registry::instance())
+            : m_registry(r)
+        {}
+
+        template <compute_mode M, typename... Args>
+        auto apply(Args&&... args) -> result<K, Args...>;
+
+      private:
+        const kernel_registry* m_registry;
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    template <typename Sig>
+    void kernel_registry::add(const char* name, Sig* fn, compute_mode m, uint32_t required_isa, int priority)
+    {
+        add(kernel_impl{
+            name, typeid(Sig).name(), m, required_isa, priority, reinterpret_cast<void(*)()>(fn) });
+    }
+
+    template <typename K>
+    void kernel_registry::add(typename K::signature* fn, compute_mode m, uint32_t required_isa, int priority)
+    {
+        add<typename K::signature>(K::traits::name, fn, m, required_isa, priority);
+    }
+
+    /*  add(kernel_impl) is inline so plugins can call it without
+     *  linking against kernelpp. */
+    inline void kernel_registry::add(kernel_impl impl)
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_impls.push_back(std::move(impl));
+    }
+
+    template <typename Sig>
+    Sig* kernel_registry::find(const char* name, compute_mode m) const
+    {
+        const kernel_impl* impl = find(name, typeid(Sig).name(), m);
+        return impl ? reinterpret_cast<Sig*>(impl->fn) : nullptr;
+    }
+
+    namespace detail
+    {
+        template <bool IsVoid> struct invoke_impl
+        {
+            template <typename R, typename F, typename... Args>
+            static R call(F* fn, Args&&... args) {
+                return fn(std::forward<Args>(args)...);
+            }
+        };
+
+        template <> struct invoke_impl<true>
+        {
+            template <typename R, typename F, typename... Args>
+            static R call(F* fn, Args&&... args) {
+                fn(std::forward<Args>(args)...);
+                return error_code::NONE;
+            }
+        };
+    }
+
+    template <typename K, typename Sig>
+    template <compute_mode M, typename... Args>
+    auto registry_runner<K, Sig>::apply(Args&&... args) -> result<K, Args...>
+    {
+        /* the lookup is cached per thread until the registry is republished */
+        struct cache {
+            const kernel_registry* registry = nullptr;
+            uint64_t generation = 0;
+            Sig* fn = nullptr;
+        };
+        static thread_local cache c;
+
+        const uint64_t gen = m_registry->generation();
+        if (c.registry != m_registry || c.generation != gen) {
+            c.registry = m_registry;
+            c.generation = gen;
+            c.fn = m_registry->find<Sig>(traits::name, M);
+        }
+
+        if (c.fn) {
+            return detail::invoke_impl<op_traits<K, Args...>::is_void>::template
+                call<result<K, Args...>>(c.fn, std::forward<Args>(args)...);
+        }
+        return runner<K>::template apply<M>(std::forward<Args>(args)...);
+    }
+}
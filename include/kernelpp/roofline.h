@@ -0,0 +1,156 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace kernelpp
+{
+    /*  The cost of a kernel per element processed. Specialize this for
+     *  kernels which should appear in a roofline report:
+     *
+     *      template <> struct cost_traits<saxpy> {
+     *          static constexpr double bytes_per_element = 12;
+     *          static constexpr double flops_per_element = 2;
+     *      };
+     */
+    template <typename K>
+    struct cost_traits
+    {
+        static constexpr double bytes_per_element = 0;
+        static constexpr double flops_per_element = 0;
+    };
+
+    /*  Peak read bandwidth for a working set of `bytes` */
+    struct bandwidth_ceiling
+    {
+        const char* level;
+        size_t bytes;
+        double bytes_per_sec;
+    };
+
+    /*  Performance ceilings of the host, measured on a single core */
+    struct machine_ceilings
+    {
+        /* in increasing order of working set size, ending with DRAM */
+        std::vector<bandwidth_ceiling> bandwidth;
+
+        double cpu_flops = 0;
+        double avx_flops = 0;
+
+        double peak_flops(compute_mode m) const;
+
+        /*  The bandwidth of the smallest level which holds `bytes` */
+        double bandwidth_for(size_t bytes) const;
+    };
+
+    /*  Measures the ceilings of the host. Each measurement runs for at
+     *  least `min_seconds`. The DRAM bandwidth is measured with a working
+     *  set of `dram_bytes`, which should be several times the size of the
+     *  last level cache.
+     */
+    machine_ceilings measure_ceilings(
+        double min_seconds = 0.1, size_t dram_bytes = size_t(256) << 20);
+
+    /*  A single kernel invocation placed on the roofline */
+    struct roofline_sample
+    {
+        const char* kernel;
+        compute_mode mode;
+        size_t elements;
+        double seconds;
+
+        double flops_per_sec;
+        double bytes_per_sec;
+
+        /* flops per byte */
+        double intensity;
+
+        /* attainable flop/s and bytes/s at this intensity and working set */
+        double attainable_flops;
+        double attainable_bytes;
+
+        /* achieved / attainable, against whichever ceiling binds */
+        double efficiency;
+        bool memory_bound;
+    };
+
+    /*  Collects samples from `roofline_runner`s */
+    class roofline_report final
+    {
+        machine_ceilings m_ceilings;
+        std::vector<roofline_sample> m_samples;
+        mutable std::mutex m_mtx;
+
+      public:
+        explicit roofline_report(machine_ceilings ceilings);
+
+        void add(const char* kernel, compute_mode mode, size_t elements,
+                 double bytes_per_element, double flops_per_element, double seconds);
+
+        std::vector<roofline_sample> samples() const;
+        const machine_ceilings& ceilings() const { return m_ceilings; }
+
+        /*  One row per sample, with a header */
+        void write_csv(std::ostream& out) const;
+
+        /*  The ceilings and samples as a single json object */
+        void write_json(std::ostream& out) const;
+    };
+
+    /*  `roofline_runner<K>` times each invocation of `K` which processes
+     *  `elements` elements, and adds it to a report using the kernel's
+     *  `cost_traits`.
+     */
+    template <typename K>
+    struct roofline_runner : public runner<K>
+    {
+        using typename runner<K>::traits;
+        using clock = std::chrono::steady_clock;
+
+        roofline_runner(roofline_report* report, size_t elements)
+            : m_report(report), m_elements(elements)
+        {}
+
+        bool begin(compute_mode m)
+        {
+            m_mode = m;
+            m_t0 = clock::now();
+            return true;
+        }
+
+        void end(error_code s)
+        {
+            const std::chrono::duration<double> dt = clock::now() - m_t0;
+            if (s != error_code::NONE) { return; }
+
+            m_report->add(traits::name, m_mode, m_elements,
+                cost_traits<K>::bytes_per_element,
+                cost_traits<K>::flops_per_element, dt.count());
+        }
+
+      private:
+        roofline_report* m_report;
+        size_t m_elements;
+        compute_mode m_mode = compute_mode::AUTO;
+        clock::time_point m_t0;
+    };
+}
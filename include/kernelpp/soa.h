@@ -0,0 +1,293 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <gsl.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+namespace kernelpp
+{
+    namespace detail
+    {
+        /*  Copies a field of `width` bytes at offset 0 of each of `n`
+         *  records spaced `stride` bytes apart in to a contiguous column,
+         *  and back again. The AVX gather handles 4 and 8 byte fields.
+         */
+        KERNEL_DECL(soa_gather, compute_mode::CPU, compute_mode::AVX)
+        {
+            template <compute_mode M>
+            static void op(const uint8_t* aos, size_t stride, size_t width, size_t n, uint8_t* col);
+        };
+
+        KERNEL_DECL(soa_scatter, compute_mode::CPU)
+        {
+            template <compute_mode M>
+            static void op(const uint8_t* col, size_t stride, size_t width, size_t n, uint8_t* aos);
+        };
+
+        template <> void soa_gather::op<compute_mode::CPU>(
+            const uint8_t*, size_t, size_t, size_t, uint8_t*);
+        template <> void soa_gather::op<compute_mode::AVX>(
+            const uint8_t*, size_t, size_t, size_t, uint8_t*);
+        template <> void soa_scatter::op<compute_mode::CPU>(
+            const uint8_t*, size_t, size_t, size_t, uint8_t*);
+    }
+
+    /*  `soa<Ts...>` is a structure-of-arrays container with one column per
+     *  field type. Each column is aligned to `alignment` bytes, and padded
+     *  with zeros to a multiple of `block` elements, so kernels can process
+     *  whole vectors with aligned loads and no remainder loop.
+     *
+     *  Records may be converted from and to an array of structs `S`, where
+     *  `S` is laid out as the fields `Ts...` in order without padding.
+     */
+    template <typename... Ts>
+    class soa final
+    {
+        static constexpr size_t N = sizeof...(Ts);
+
+        static_assert(N > 0, "soa requires at least one field");
+
+        std::unique_ptr<uint8_t[]> m_raw[N];
+        uint8_t* m_cols[N];
+        size_t m_size = 0;
+        size_t m_padded = 0;
+
+      public:
+        template <size_t I>
+        using field_type = std::tuple_element_t<I, std::tuple<Ts...>>;
+
+        static constexpr size_t alignment = 32;
+        static constexpr size_t block = 32;
+
+        soa();
+        explicit soa(size_t n);
+
+        /*  Moved-from containers are left empty */
+        soa(soa&& other);
+        soa& operator=(soa&& other);
+
+        /*  Resizes every column, preserving the first min(size(), n)
+         *  records. New records are zero initialized.
+         */
+        void resize(size_t n);
+
+        size_t size() const { return m_size; }
+        size_t padded_size() const { return m_padded; }
+
+        /*  The first `size()` elements of column `I` */
+        template <size_t I> gsl::span<field_type<I>> column();
+        template <size_t I> gsl::span<const field_type<I>> column() const;
+
+        /*  Column `I` including padding, i.e. `padded_size()` elements */
+        template <size_t I> gsl::span<field_type<I>> padded_column();
+
+        /*  Replaces the contents with the records in `aos` */
+        template <typename S> void assign(gsl::span<const S> aos);
+
+        /*  Copies the records to `aos`, which must have `size()` elements */
+        template <typename S> void copy_to(gsl::span<S> aos) const;
+
+        /*  Calls `f(offset, gsl::span<Ts>... columns)` for consecutive
+         *  blocks of the padded columns. `n` is rounded up to a multiple
+         *  of `block`, so every span is a whole number of blocks.
+         */
+        template <typename F> void for_each_block(F&& f, size_t n = block);
+
+      private:
+        template <typename S> static void check_layout();
+
+        template <typename F, size_t... Is>
+        void call_block(F& f, size_t offset, size_t n, std::index_sequence<Is...>);
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    namespace detail
+    {
+        constexpr size_t sum() { return 0; }
+
+        template <typename... Ts>
+        constexpr size_t sum(size_t x, Ts... xs) { return x + sum(xs...); }
+    }
+
+    template <typename... Ts> constexpr size_t soa<Ts...>::alignment;
+    template <typename... Ts> constexpr size_t soa<Ts...>::block;
+
+    template <typename... Ts>
+    soa<Ts...>::soa()
+    {
+        std::fill(m_cols, m_cols + N, nullptr);
+    }
+
+    template <typename... Ts>
+    soa<Ts...>::soa(size_t n) : soa()
+    {
+        resize(n);
+    }
+
+    template <typename... Ts>
+    soa<Ts...>::soa(soa&& other) : soa()
+    {
+        *this = std::move(other);
+    }
+
+    template <typename... Ts>
+    soa<Ts...>& soa<Ts...>::operator=(soa&& other)
+    {
+        if (this != &other) {
+            for (size_t i = 0; i < N; i++) {
+                m_raw[i] = std::move(other.m_raw[i]);
+                m_cols[i] = other.m_cols[i];
+                other.m_cols[i] = nullptr;
+            }
+            m_size = other.m_size;
+            m_padded = other.m_padded;
+            other.m_size = 0;
+            other.m_padded = 0;
+        }
+        return *this;
+    }
+
+    template <typename... Ts>
+    void soa<Ts...>::resize(size_t n)
+    {
+        const size_t widths[N] = { sizeof(Ts)... };
+        const size_t padded = ((n + block - 1) / block) * block;
+
+        /* reuse the existing columns when the padded size is unchanged,
+         * zeroing everything past the records kept, as block kernels may
+         * have written to the padding */
+        if (padded == m_padded && m_cols[0]) {
+            const size_t kept = std::min(n, m_size);
+            for (size_t i = 0; i < N; i++) {
+                std::memset(m_cols[i] + kept * widths[i], 0, (m_padded - kept) * widths[i]);
+            }
+            m_size = n;
+            return;
+        }
+
+        for (size_t i = 0; i < N; i++) {
+            const size_t bytes = padded * widths[i];
+
+            std::unique_ptr<uint8_t[]> raw(new uint8_t[bytes + alignment]());
+            uint8_t* col = raw.get() + (alignment - (uintptr_t) raw.get() % alignment) % alignment;
+
+            if (m_cols[i]) {
+                std::memcpy(col, m_cols[i], std::min(n, m_size) * widths[i]);
+            }
+
+            m_raw[i] = std::move(raw);
+            m_cols[i] = col;
+        }
+
+        m_size = n;
+        m_padded = padded;
+    }
+
+    template <typename... Ts>
+    template <size_t I>
+    gsl::span<typename soa<Ts...>::template field_type<I>> soa<Ts...>::column()
+    {
+        return gsl::span<field_type<I>>(reinterpret_cast<field_type<I>*>(m_cols[I]), m_size);
+    }
+
+    template <typename... Ts>
+    template <size_t I>
+    gsl::span<const typename soa<Ts...>::template field_type<I>> soa<Ts...>::column() const
+    {
+        return gsl::span<const field_type<I>>(
+            reinterpret_cast<const field_type<I>*>(m_cols[I]), m_size);
+    }
+
+    template <typename... Ts>
+    template <size_t I>
+    gsl::span<typename soa<Ts...>::template field_type<I>> soa<Ts...>::padded_column()
+    {
+        return gsl::span<field_type<I>>(reinterpret_cast<field_type<I>*>(m_cols[I]), m_padded);
+    }
+
+    template <typename... Ts>
+    template <typename S>
+    void soa<Ts...>::check_layout()
+    {
+        static_assert(std::is_standard_layout<S>::value && std::is_trivially_copyable<S>::value,
+            "soa requires a trivially copyable, standard layout record type");
+        static_assert(sizeof(S) == detail::sum(sizeof(Ts)...),
+            "soa requires the record type to be laid out as the fields, without padding");
+    }
+
+    template <typename... Ts>
+    template <typename S>
+    void soa<Ts...>::assign(gsl::span<const S> aos)
+    {
+        check_layout<S>();
+
+        const size_t widths[N] = { sizeof(Ts)... };
+        resize(aos.size());
+
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(aos.data());
+        for (size_t i = 0, offset = 0; i < N; offset += widths[i], i++) {
+            run<detail::soa_gather>(base + offset, sizeof(S), widths[i], m_size, m_cols[i]);
+        }
+
+        /* the padding may have been written to by a previous assignment */
+        for (size_t i = 0; i < N; i++) {
+            std::memset(m_cols[i] + m_size * widths[i], 0, (m_padded - m_size) * widths[i]);
+        }
+    }
+
+    template <typename... Ts>
+    template <typename S>
+    void soa<Ts...>::copy_to(gsl::span<S> aos) const
+    {
+        check_layout<S>();
+
+        const size_t widths[N] = { sizeof(Ts)... };
+        const size_t n = std::min<size_t>(aos.size(), m_size);
+
+        uint8_t* base = reinterpret_cast<uint8_t*>(aos.data());
+        for (size_t i = 0, offset = 0; i < N; offset += widths[i], i++) {
+            run<detail::soa_scatter>(m_cols[i], sizeof(S), widths[i], n, base + offset);
+        }
+    }
+
+    template <typename... Ts>
+    template <typename F, size_t... Is>
+    void soa<Ts...>::call_block(F& f, size_t offset, size_t n, std::index_sequence<Is...>)
+    {
+        f(offset, gsl::span<Ts>(reinterpret_cast<Ts*>(m_cols[Is]) + offset, n)...);
+    }
+
+    template <typename... Ts>
+    template <typename F>
+    void soa<Ts...>::for_each_block(F&& f, size_t n)
+    {
+        n = std::max(block, ((n + block - 1) / block) * block);
+
+        for (size_t offset = 0; offset < m_padded; offset += n) {
+            call_block(f, offset, std::min(n, m_padded - offset), std::index_sequence_for<Ts...>());
+        }
+    }
+}
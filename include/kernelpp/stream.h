@@ -0,0 +1,225 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+#include "kernelpp/types.h"
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+
+#include <gsl.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace kernelpp
+{
+    /*  `window_reader` provides sequential, read-only access to a file
+     *  one window at a time. On POSIX systems each window is memory-mapped
+     *  and the following window is mapped ahead of time and advised with
+     *  `MADV_WILLNEED`, so the OS reads it in while the current window
+     *  is being processed. At most two windows are mapped at any time.
+     */
+    class window_reader final
+    {
+        struct impl;
+        struct impl_deleter { void operator()(impl*) const; };
+        std::unique_ptr<impl, impl_deleter> m_impl;
+
+      public:
+        window_reader();
+        window_reader(window_reader&& other);
+        ~window_reader();
+
+        /*  Opens the file at `path`. `window` is rounded up to a
+         *  multiple of `granularity()`.
+         */
+        status open(const char* path, size_t window);
+
+        /*  Maps the next window of the file. Any span returned by a
+         *  previous call is invalidated. Returns an empty span at the
+         *  end of the file.
+         */
+        maybe<gsl::span<const uint8_t>> next();
+
+        size_t file_size() const;
+        size_t window() const;
+
+        /*  The offset granularity of a window, i.e. the page size  */
+        static size_t granularity();
+    };
+
+    /*  Statistics gathered by a `stream_driver` */
+    struct stream_stats
+    {
+        size_t bytes  = 0;
+        size_t chunks = 0;
+
+        /* total wall time, and the portion spent in the kernel */
+        double seconds = 0;
+        double kernel_seconds = 0;
+
+        double throughput() const { return seconds > 0 ? bytes / seconds : 0; }
+    };
+
+    /*  Reads the file at `path` sequentially with plain buffered reads
+     *  and returns the read throughput in bytes/sec. Use this as the
+     *  baseline for `stream_stats::throughput()`. Note both are subject
+     *  to the state of the page cache.
+     */
+    maybe<double> measure_read_throughput(const char* path, size_t block = 1 << 20);
+
+    /*  `stream_driver<T>` runs a kernel over a binary file of `T` one
+     *  window at a time, such that peak memory is bounded by the window
+     *  size rather than the size of the file. Kernels are invoked as
+     *
+     *      run<K, M>(gsl::span<const T> chunk, args...)
+     *
+     *  Stateful kernels carry state between chunks through `args`,
+     *  which are passed to every invocation by reference.
+     */
+    template <typename T>
+    class stream_driver final
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+            "stream_driver requires a trivially copyable element type");
+
+        window_reader m_reader;
+        stream_stats m_stats;
+        size_t m_window;
+
+      public:
+        /*  `window` is the preferred number of elements per chunk. */
+        explicit stream_driver(size_t window);
+
+        status open(const char* path);
+
+        /*  Invokes `K` for each chunk in the file, stopping at the
+         *  first chunk for which the kernel fails.
+         */
+        template <typename K, compute_mode M = compute_mode::AUTO, typename... Args>
+        status run(Args&&... args);
+
+        /*  Invokes `K` for each chunk in the file and folds each result
+         *  in to `init` with `fn(R acc, R chunk_result)`.
+         */
+        template <
+            typename K, compute_mode M = compute_mode::AUTO,
+            typename R, typename Reduce, typename... Args
+            >
+        maybe<R> reduce(R init, Reduce fn, Args&&... args);
+
+        const stream_stats& stats() const { return m_stats; }
+
+      private:
+        template <typename F> status for_each_chunk(F&& f);
+    };
+
+
+    /*  Implementation detail ---------------------------------------------- */
+
+    namespace detail
+    {
+        template <typename T>
+        constexpr size_t gcd(T a, T b) { return b == 0 ? a : gcd(b, a % b); }
+    }
+
+    template <typename T>
+    stream_driver<T>::stream_driver(size_t window)
+        : m_window{ window > 0 ? window : 1 }
+    {}
+
+    template <typename T>
+    status stream_driver<T>::open(const char* path)
+    {
+        /* windows must start on a page boundary, and contain whole elements */
+        const size_t page = window_reader::granularity();
+        const size_t unit = page / detail::gcd(page, sizeof(T)) * sizeof(T);
+        const size_t bytes = m_window * sizeof(T);
+
+        status s = m_reader.open(path, ((bytes + unit - 1) / unit) * unit);
+        if (s) { return s; }
+
+        if (m_reader.file_size() % sizeof(T) != 0) {
+            return status{ "file size is not a multiple of the element size" };
+        }
+
+        m_stats = stream_stats();
+        return s;
+    }
+
+    template <typename T>
+    template <typename F>
+    status stream_driver<T>::for_each_chunk(F&& f)
+    {
+        using clock = std::chrono::steady_clock;
+        using seconds = std::chrono::duration<double>;
+
+        const auto t0 = clock::now();
+        status s;
+
+        for (;;) {
+            maybe<gsl::span<const uint8_t>> w = m_reader.next();
+            if (w.template is<error>()) {
+                s = status{ w.template get<error>() };
+                break;
+            }
+
+            gsl::span<const uint8_t> bytes = w.template get<gsl::span<const uint8_t>>();
+            if (bytes.size() == 0) { break; }
+
+            gsl::span<const T> chunk(
+                reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T));
+
+            const auto k0 = clock::now();
+            s = f(chunk);
+            m_stats.kernel_seconds += seconds(clock::now() - k0).count();
+
+            m_stats.bytes += bytes.size();
+            m_stats.chunks++;
+
+            if (s) { break; }
+        }
+
+        m_stats.seconds += seconds(clock::now() - t0).count();
+        return s;
+    }
+
+    template <typename T>
+    template <typename K, compute_mode M, typename... Args>
+    status stream_driver<T>::run(Args&&... args)
+    {
+        return for_each_chunk([&](gsl::span<const T> chunk) {
+            return detail::to_status(kernelpp::run<K, M>(chunk, args...));
+        });
+    }
+
+    template <typename T>
+    template <typename K, compute_mode M, typename R, typename Reduce, typename... Args>
+    maybe<R> stream_driver<T>::reduce(R init, Reduce fn, Args&&... args)
+    {
+        R acc = std::move(init);
+
+        status s = for_each_chunk([&](gsl::span<const T> chunk) -> status {
+            auto r = kernelpp::run<K, M>(chunk, args...);
+            if (r.template is<error>()) { return status{ r.template get<error>() }; }
+
+            acc = fn(std::move(acc), std::move(r.template get<R>()));
+            return status();
+        });
+
+        if (s) { return *s; }
+        return acc;
+    }
+}
@@ -0,0 +1,420 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "kernelpp/capture.h"
+#include "library.h"
+
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+
+#if defined(kernelpp_WITH_ZLIB)
+#   include <zlib.h>
+#endif
+
+namespace
+{
+    /*  A capture file is a header, followed by records of the form
+     *
+     *      u32 size, u32 stored size, stored bytes
+     *
+     *  where the stored bytes are zlib compressed if the header's
+     *  compressed flag is set and the stored size differs from the size.
+     *  Values are in the byte order of the host.
+     */
+    const char magic[8] = { 'K', 'P', 'P', 'C', 'A', 'P', '\x01', '\0' };
+    const uint32_t compressed_flag = 1;
+
+    template <typename T>
+    bool get(const uint8_t*& p, const uint8_t* end, T& v)
+    {
+        if (size_t(end - p) < sizeof(T)) { return false; }
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return true;
+    }
+
+    double element(const kernelpp::capture_arg& a, size_t i)
+    {
+        const uint8_t* p = a.bytes.data() + i * (a.elem & 0x0f);
+
+        auto load = [p](auto v) { std::memcpy(&v, p, sizeof(v)); return double(v); };
+
+        switch (a.elem) {
+        case 0x44: return load(float());
+        case 0x48: return load(double());
+        case 0x21: return load(int8_t());
+        case 0x22: return load(int16_t());
+        case 0x24: return load(int32_t());
+        case 0x28: return load(int64_t());
+        case 0x01: return load(uint8_t());
+        case 0x02: return load(uint16_t());
+        case 0x04: return load(uint32_t());
+        case 0x08: return load(uint64_t());
+        default:   return 0;
+        }
+    }
+}
+
+namespace kernelpp
+{
+    /*  encoding ----------------------------------------------------------- */
+
+    namespace detail
+    {
+        std::string capture_header(const char* kernel, compute_mode m, double seconds, size_t args)
+        {
+            std::string out;
+            const uint16_t len = uint16_t(std::strlen(kernel));
+
+            capture_put(out, &len, sizeof(len));
+            capture_put(out, kernel, len);
+            out += char(m);
+            capture_put(out, &seconds, sizeof(seconds));
+            out += char(uint8_t(args));
+
+            return out;
+        }
+
+        status capture_parse(const std::string& bytes, std::vector<capture_arg>& args)
+        {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data());
+            const uint8_t* end = p + bytes.size();
+
+            while (p < end)
+            {
+                capture_arg a;
+                if (!get(p, end, a.kind) || !get(p, end, a.elem) || !get(p, end, a.count)) {
+                    return status{ "truncated capture argument" };
+                }
+
+                const size_t width = a.elem & 0x0f;
+                if (width == 0 || a.count > size_t(end - p) / width) {
+                    return status{ "invalid capture argument" };
+                }
+
+                a.bytes.assign(p, p + a.count * width);
+                p += a.count * width;
+
+                args.push_back(std::move(a));
+            }
+            return status();
+        }
+
+        status parse_record(const std::string& bytes, capture_record& r)
+        {
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(bytes.data());
+            const uint8_t* end = p + bytes.size();
+
+            uint16_t len = 0;
+            uint8_t mode = 0, nargs = 0;
+
+            if (!get(p, end, len) || size_t(end - p) < len) { return status{ "truncated capture record" }; }
+            r.kernel.assign(reinterpret_cast<const char*>(p), len);
+            p += len;
+
+            if (!get(p, end, mode) || !get(p, end, r.seconds) || !get(p, end, nargs)) {
+                return status{ "truncated capture record" };
+            }
+            r.mode = compute_mode(mode);
+
+            r.args.clear();
+            status s = capture_parse(std::string(reinterpret_cast<const char*>(p), end - p), r.args);
+            if (s) { return s; }
+
+            if (r.args.size() != nargs) { return status{ "capture record argument count mismatch" }; }
+            return status();
+        }
+    }
+
+
+    /*  capture_writer ----------------------------------------------------- */
+
+    struct capture_writer::impl
+    {
+        std::mutex mtx;
+        FILE* file = nullptr;
+        bool compress = false;
+
+        size_t records = 0;
+        size_t dropped = 0;
+    };
+
+    void capture_writer::impl_deleter::operator()(impl* p) const
+    {
+        if (p->file) { std::fclose(p->file); }
+        delete p;
+    }
+
+    capture_writer::capture_writer() : m_impl{ new impl } {}
+    capture_writer::~capture_writer() = default;
+
+    status capture_writer::open(const char* path, bool compress)
+    {
+#if !defined(kernelpp_WITH_ZLIB)
+        if (compress) { return status{ "compression requires kernelpp_WITH_ZLIB" }; }
+#endif
+        close();
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+
+        FILE* f = std::fopen(path, "wb");
+        if (!f) { return status{ std::string("failed to create ") + path }; }
+
+        const uint32_t flags = compress ? compressed_flag : 0;
+        if (std::fwrite(magic, sizeof(magic), 1, f) != 1 ||
+            std::fwrite(&flags, sizeof(flags), 1, f) != 1)
+        {
+            std::fclose(f);
+            return status{ std::string("failed to write ") + path };
+        }
+
+        m_impl->file = f;
+        m_impl->compress = compress;
+        return status();
+    }
+
+    status capture_writer::write(const std::string& record)
+    {
+        std::string stored;
+        bool compressed = false;
+
+#if defined(kernelpp_WITH_ZLIB)
+        if (m_impl->compress) {
+            uLongf n = compressBound(uLong(record.size()));
+            stored.resize(n);
+
+            if (compress2(reinterpret_cast<Bytef*>(&stored[0]), &n,
+                    reinterpret_cast<const Bytef*>(record.data()), uLong(record.size()), Z_BEST_SPEED) == Z_OK
+                && n < record.size())
+            {
+                stored.resize(n);
+                compressed = true;
+            }
+        }
+#endif
+        const std::string& out = compressed ? stored : record;
+        const uint32_t size[2] = { uint32_t(record.size()), uint32_t(out.size()) };
+
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+
+        if (!m_impl->file || record.size() > UINT32_MAX ||
+            std::fwrite(size, sizeof(size), 1, m_impl->file) != 1 ||
+            std::fwrite(out.data(), 1, out.size(), m_impl->file) != out.size())
+        {
+            m_impl->dropped++;
+            return status{ "failed to write capture record" };
+        }
+
+        m_impl->records++;
+        return status();
+    }
+
+    void capture_writer::close()
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+        if (m_impl->file) {
+            std::fclose(m_impl->file);
+            m_impl->file = nullptr;
+        }
+    }
+
+    size_t capture_writer::records() const
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+        return m_impl->records;
+    }
+
+    size_t capture_writer::dropped() const
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+        return m_impl->dropped;
+    }
+
+
+    /*  capture_reader ----------------------------------------------------- */
+
+    struct capture_reader::impl
+    {
+        FILE* file = nullptr;
+        bool compressed = false;
+    };
+
+    void capture_reader::impl_deleter::operator()(impl* p) const
+    {
+        if (p->file) { std::fclose(p->file); }
+        delete p;
+    }
+
+    capture_reader::capture_reader() : m_impl{ new impl } {}
+    capture_reader::~capture_reader() = default;
+
+    status capture_reader::open(const char* path)
+    {
+        if (m_impl->file) {
+            std::fclose(m_impl->file);
+            m_impl->file = nullptr;
+        }
+
+        FILE* f = std::fopen(path, "rb");
+        if (!f) { return status{ std::string("failed to open ") + path }; }
+
+        char m[sizeof(magic)];
+        uint32_t flags = 0;
+
+        if (std::fread(m, sizeof(m), 1, f) != 1 || std::memcmp(m, magic, sizeof(m)) != 0 ||
+            std::fread(&flags, sizeof(flags), 1, f) != 1)
+        {
+            std::fclose(f);
+            return status{ std::string(path) + " is not a capture file" };
+        }
+
+#if !defined(kernelpp_WITH_ZLIB)
+        if (flags & compressed_flag) {
+            std::fclose(f);
+            return status{ "reading compressed captures requires kernelpp_WITH_ZLIB" };
+        }
+#endif
+        m_impl->file = f;
+        m_impl->compressed = (flags & compressed_flag) != 0;
+        return status();
+    }
+
+    maybe<bool> capture_reader::next(capture_record& r)
+    {
+        if (!m_impl->file) { return error("capture file not open"); }
+
+        uint32_t size[2];
+        const size_t n = std::fread(size, sizeof(size), 1, m_impl->file);
+
+        if (n != 1) {
+            if (std::feof(m_impl->file)) { return false; }
+            return error("failed to read capture record");
+        }
+
+        std::string stored(size[1], '\0');
+        if (size[1] && std::fread(&stored[0], 1, size[1], m_impl->file) != size[1]) {
+            return error("truncated capture record");
+        }
+
+        std::string record;
+        if (size[0] == size[1]) {
+            record = std::move(stored);
+        }
+        else {
+#if defined(kernelpp_WITH_ZLIB)
+            record.resize(size[0]);
+            uLongf len = size[0];
+
+            if (uncompress(reinterpret_cast<Bytef*>(&record[0]), &len,
+                    reinterpret_cast<const Bytef*>(stored.data()), uLong(stored.size())) != Z_OK
+                || len != size[0])
+            {
+                return error("corrupt capture record");
+            }
+#else
+            return error("corrupt capture record");
+#endif
+        }
+
+        status s = detail::parse_record(record, r);
+        if (s) { return *s; }
+
+        return true;
+    }
+
+
+    /*  replay ------------------------------------------------------------- */
+
+    capture_diff compare(const std::vector<capture_arg>& a,
+                         const std::vector<capture_arg>& b, double tolerance)
+    {
+        capture_diff d;
+
+        if (a.size() != b.size()) {
+            d.comparable = false;
+            return d;
+        }
+
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (a[i].kind != b[i].kind || a[i].elem != b[i].elem || a[i].count != b[i].count) {
+                d.comparable = false;
+                return d;
+            }
+
+            const bool exact = (a[i].elem & 0x40) == 0;
+
+            for (size_t j = 0; j < a[i].count; j++)
+            {
+                const double x = element(a[i], j), y = element(b[i], j);
+                const double abs = std::fabs(x - y);
+                const double rel = abs / std::max(std::fabs(x), std::fabs(y));
+
+                const bool same = (x == y) || (std::isnan(x) && std::isnan(y));
+                if (same) { continue; }
+
+                d.max_abs = std::max(d.max_abs, abs);
+                d.max_rel = std::max(d.max_rel, rel);
+
+                if (exact || !(rel <= tolerance)) { d.mismatched++; }
+            }
+        }
+        return d;
+    }
+
+    replay_registry& replay_registry::instance()
+    {
+        static replay_registry r;
+        return r;
+    }
+
+    replay_registry::invoker replay_registry::find(const std::string& kernel) const
+    {
+        auto it = m_invokers.find(kernel);
+        return it == m_invokers.end() ? nullptr : it->second;
+    }
+
+    status replay_registry::load_plugin(const char* path)
+    {
+        using register_fn = void (*)(replay_registry&);
+
+        void* lib = detail::open_library(path);
+        if (!lib) { return status{ detail::library_error() }; }
+
+        register_fn reg = reinterpret_cast<register_fn>(detail::find_symbol(lib, "kernelpp_replay_register"));
+        if (!reg) {
+            detail::close_library(lib);
+            return status{ std::string(path) + " is not a replay plugin" };
+        }
+
+        /* the library stays loaded, as its invokers are referenced */
+        reg(*this);
+        return status();
+    }
+
+    replay_result replay(const replay_registry& registry, const capture_record& r,
+                         compute_mode m, size_t reps)
+    {
+        replay_registry::invoker fn = registry.find(r.kernel);
+
+        if (!fn) {
+            replay_result res;
+            res.mode = m;
+            res.result = status{ "kernel '" + r.kernel + "' is not registered for replay" };
+            return res;
+        }
+        return fn(r, m, reps);
+    }
+}
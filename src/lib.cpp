@@ -57,30 +57,48 @@ uint64_t xgetbv(const std::uint32_t xcr)
 
 namespace kernelpp
 {
-    bool init_avx(void)
+    uint32_t cpu_features()
     {
-        static bool success{ false };
+        static uint32_t features{ 0 };
         static std::once_flag flag;
 
         std::call_once(flag, [&]() {
-            /* determine whether the CPU supports avx and avx2 */
             uint32_t cpu_info[4] = {0};
 
             cpuid(cpu_info, 1u);
             bool osUsesXSAVE_XRSTORE = cpu_info[2] & (1 << 27) || false;
             bool cpuAVXSupport = cpu_info[2] & (1 << 28) || false;
+            bool cpuFMASupport = cpu_info[2] & (1 << 12) || false;
+
+            if (!osUsesXSAVE_XRSTORE || !cpuAVXSupport) { return; }
+
+            /* check the OS will save the YMM (and ZMM) registers */
+            unsigned long long xcrFeatureMask = xgetbv(_XCR_XFEATURE_ENABLED_MASK);
+            if ((xcrFeatureMask & 0x6) != 0x6) { return; }
+
+            bool osAVX512Support = (xcrFeatureMask & 0xe0) == 0xe0;
 
             cpuid(cpu_info, 7u);
-            bool cpuAVX2Support = cpu_info[1] & (1 << 5) || false;
+            uint32_t ebx = cpu_info[1];
+
+            features |= isa::AVX;
+            if (cpuFMASupport)   { features |= isa::FMA; }
+            if (ebx & (1u << 5)) { features |= isa::AVX2; }
 
-            if (osUsesXSAVE_XRSTORE && cpuAVXSupport && cpuAVX2Support)
-            {
-                /* check the OS will save the YMM registers */
-                unsigned long long xcrFeatureMask = xgetbv(_XCR_XFEATURE_ENABLED_MASK);
-                success = (xcrFeatureMask & 0x6) == 0x6;
+            if (osAVX512Support) {
+                if (ebx & (1u << 16)) { features |= isa::AVX512F; }
+                if (ebx & (1u << 17)) { features |= isa::AVX512DQ; }
+                if (ebx & (1u << 30)) { features |= isa::AVX512BW; }
+                if (ebx & (1u << 31)) { features |= isa::AVX512VL; }
             }
         });
 
-        return success;
+        return features;
+    }
+
+    bool init_avx(void)
+    {
+        const uint32_t avx = isa::AVX | isa::AVX2;
+        return (cpu_features() & avx) == avx;
     }
 }
@@ -0,0 +1,46 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+/*  Loading of shared libraries, shared by the kernel and replay registries */
+
+#pragma once
+
+#include <string>
+
+#if defined(_WIN32)
+#   include <windows.h>
+#else
+#   include <dlfcn.h>
+#endif
+
+namespace kernelpp { namespace detail
+{
+#if defined(_WIN32)
+    inline void* open_library(const char* path) { return (void*) ::LoadLibraryA(path); }
+    inline void  close_library(void* lib) { ::FreeLibrary((HMODULE) lib); }
+    inline void* find_symbol(void* lib, const char* name) {
+        return (void*) ::GetProcAddress((HMODULE) lib, name);
+    }
+    inline std::string library_error() { return "error " + std::to_string(::GetLastError()); }
+#else
+    inline void* open_library(const char* path) { return ::dlopen(path, RTLD_NOW | RTLD_LOCAL); }
+    inline void  close_library(void* lib) { ::dlclose(lib); }
+    inline void* find_symbol(void* lib, const char* name) { return ::dlsym(lib, name); }
+    inline std::string library_error() {
+        const char* e = ::dlerror();
+        return e ? e : "unknown error";
+    }
+#endif
+}}
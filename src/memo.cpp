@@ -0,0 +1,253 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "kernelpp/memo.h"
+#include "kernelpp/avx_util.h"
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+#if defined(kernelpp_WITH_AVX)
+#   include <immintrin.h>
+#endif
+
+namespace
+{
+    /*  The hash consumes 32-byte stripes in to four 64-bit lanes,
+     *  acc += lo32(d ^ key) * hi32(d ^ key) + d, which maps directly on
+     *  to _mm256_mul_epu32. The key of each lane advances by `stripe_key`
+     *  every stripe, so the result depends on the order of the stripes.
+     *  The lanes and any remaining bytes are then mixed in to a single
+     *  value.
+     */
+    const uint64_t lane_keys[4] = {
+        0x9e3779b185ebca87ull, 0xc2b2ae3d27d4eb4full,
+        0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull
+    };
+    const uint64_t stripe_key = 0x85ebca77c2b2ae63ull;
+
+    inline uint64_t load64(const uint8_t* p)
+    {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    /* splitmix64 finalizer */
+    inline uint64_t mix(uint64_t h)
+    {
+        h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 27; h *= 0x94d049bb133111ebull;
+        h ^= h >> 31;
+        return h;
+    }
+
+    uint64_t finalize(const uint64_t acc[4], const uint8_t* tail, size_t n, size_t len, uint64_t seed)
+    {
+        uint64_t h = mix(seed ^ (len * lane_keys[0]));
+        for (int i = 0; i < 4; i++) { h = mix(h ^ acc[i]); }
+
+        for (; n >= 8; n -= 8, tail += 8) {
+            h = mix(h ^ load64(tail));
+        }
+        if (n > 0) {
+            uint64_t v = 0;
+            std::memcpy(&v, tail, n);
+            h = mix(h ^ v ^ (uint64_t(n) << 56));
+        }
+        return h;
+    }
+
+#if defined(kernelpp_WITH_AVX)
+    kernelpp_AVX_FN
+    void accumulate_avx(uint64_t acc[4], const uint8_t* p, size_t stripes)
+    {
+        const __m256i step = _mm256_set1_epi64x(int64_t(stripe_key));
+        __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lane_keys));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+
+        for (size_t s = 0; s < stripes; s++, p += 32) {
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            const __m256i k = _mm256_xor_si256(d, key);
+            const __m256i prod = _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+
+            a = _mm256_add_epi64(a, _mm256_add_epi64(prod, d));
+            key = _mm256_add_epi64(key, step);
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), a);
+    }
+#endif
+}
+
+namespace kernelpp
+{
+    template <>
+    uint64_t hash_bytes::op<compute_mode::CPU>(const void* data, size_t len, uint64_t seed)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const size_t stripes = len / 32;
+
+        uint64_t acc[4] = { seed, seed, seed, seed };
+
+        for (size_t s = 0; s < stripes; s++, p += 32) {
+            for (int i = 0; i < 4; i++) {
+                const uint64_t d = load64(p + i * 8);
+                const uint64_t k = d ^ (lane_keys[i] + s * stripe_key);
+                acc[i] += (k & 0xffffffffull) * (k >> 32) + d;
+            }
+        }
+
+        return finalize(acc, p, len % 32, len, seed);
+    }
+
+#if defined(kernelpp_WITH_AVX)
+    template <>
+    uint64_t hash_bytes::op<compute_mode::AVX>(const void* data, size_t len, uint64_t seed)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const size_t stripes = len / 32;
+
+        uint64_t acc[4] = { seed, seed, seed, seed };
+        accumulate_avx(acc, p, stripes);
+
+        return finalize(acc, p + stripes * 32, len % 32, len, seed);
+    }
+#endif
+
+
+    /*  memo_cache --------------------------------------------------------- */
+
+    struct memo_cache::shard
+    {
+        struct entry {
+            uint64_t key;
+            uint64_t check;
+            std::shared_ptr<const void> value;
+        };
+
+        mutable std::mutex mtx;
+        size_t capacity = 0;
+
+        /* most recently used at the front */
+        std::list<entry> lru;
+        std::unordered_map<uint64_t, std::list<entry>::iterator> index;
+
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t collisions = 0;
+    };
+
+    memo_cache::memo_cache(size_t capacity, size_t shards)
+        : m_num_shards{ shards > 0 ? shards : 1 }
+    {
+        m_shards.reset(new shard[m_num_shards]);
+
+        /* spread the capacity evenly, with at least one entry per shard */
+        for (size_t i = 0; i < m_num_shards; i++) {
+            const size_t n = capacity / m_num_shards + (i < capacity % m_num_shards ? 1 : 0);
+            m_shards[i].capacity = n > 0 ? n : 1;
+        }
+    }
+
+    memo_cache::~memo_cache() = default;
+
+    std::shared_ptr<const void> memo_cache::find(uint64_t key, uint64_t check)
+    {
+        shard& s = m_shards[key % m_num_shards];
+        std::lock_guard<std::mutex> lock(s.mtx);
+
+        auto it = s.index.find(key);
+        if (it == s.index.end()) {
+            s.misses++;
+            return nullptr;
+        }
+
+        if (it->second->check != check) {
+            s.collisions++;
+            s.misses++;
+            return nullptr;
+        }
+
+        s.hits++;
+        s.lru.splice(s.lru.begin(), s.lru, it->second);
+        return it->second->value;
+    }
+
+    void memo_cache::insert(uint64_t key, std::shared_ptr<const void> value, uint64_t check)
+    {
+        shard& s = m_shards[key % m_num_shards];
+        std::lock_guard<std::mutex> lock(s.mtx);
+
+        auto it = s.index.find(key);
+        if (it != s.index.end()) {
+            it->second->check = check;
+            it->second->value = std::move(value);
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+            return;
+        }
+
+        if (s.lru.size() >= s.capacity) {
+            s.index.erase(s.lru.back().key);
+            s.lru.pop_back();
+            s.evictions++;
+        }
+
+        s.lru.push_front({ key, check, std::move(value) });
+        s.index[key] = s.lru.begin();
+    }
+
+    void memo_cache::invalidate(uint64_t key)
+    {
+        shard& s = m_shards[key % m_num_shards];
+        std::lock_guard<std::mutex> lock(s.mtx);
+
+        auto it = s.index.find(key);
+        if (it != s.index.end()) {
+            s.lru.erase(it->second);
+            s.index.erase(it);
+        }
+    }
+
+    void memo_cache::clear()
+    {
+        for (size_t i = 0; i < m_num_shards; i++) {
+            shard& s = m_shards[i];
+            std::lock_guard<std::mutex> lock(s.mtx);
+
+            s.lru.clear();
+            s.index.clear();
+        }
+    }
+
+    memo_stats memo_cache::stats() const
+    {
+        memo_stats r;
+        for (size_t i = 0; i < m_num_shards; i++) {
+            const shard& s = m_shards[i];
+            std::lock_guard<std::mutex> lock(s.mtx);
+
+            r.hits += s.hits;
+            r.misses += s.misses;
+            r.evictions += s.evictions;
+            r.collisions += s.collisions;
+            r.entries += s.lru.size();
+        }
+        return r;
+    }
+}
@@ -0,0 +1,360 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "kernelpp/numa.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#   include <dirent.h>
+#   include <pthread.h>
+#   include <sched.h>
+#   include <sys/mman.h>
+#   include <sys/syscall.h>
+#   include <unistd.h>
+#endif
+
+namespace
+{
+    /* parses a cpulist such as "0-3,8-11" */
+    std::vector<int> parse_cpulist(const std::string& list)
+    {
+        std::vector<int> cpus;
+        std::stringstream ss(list);
+        std::string range;
+
+        while (std::getline(ss, range, ',')) {
+            int lo = 0, hi = 0;
+            const int n = std::sscanf(range.c_str(), "%d-%d", &lo, &hi);
+
+            if (n == 1) { hi = lo; }
+            else if (n != 2) { continue; }
+
+            for (int c = lo; c <= hi; c++) { cpus.push_back(c); }
+        }
+        return cpus;
+    }
+
+    /* the cpus the process may run on */
+    std::vector<int> allowed_cpus()
+    {
+        std::vector<int> cpus;
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        if (::sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int c = 0; c < CPU_SETSIZE; c++) {
+                if (CPU_ISSET(c, &set)) { cpus.push_back(c); }
+            }
+        }
+#endif
+        if (cpus.empty()) {
+            const int n = std::max(1u, std::thread::hardware_concurrency());
+            for (int c = 0; c < n; c++) { cpus.push_back(c); }
+        }
+        return cpus;
+    }
+
+    void pin_to(const std::vector<int>& cpus)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : cpus) { CPU_SET(c, &set); }
+
+        /* not fatal; the worker still runs, just without placement */
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+#endif
+    }
+
+    thread_local int this_node = -1;
+}
+
+namespace kernelpp
+{
+    /*  numa_topology ------------------------------------------------------ */
+
+    numa_topology numa_topology::discover()
+    {
+        numa_topology t;
+        const std::vector<int> allowed = allowed_cpus();
+
+#if defined(__linux__)
+        if (DIR* dir = ::opendir("/sys/devices/system/node"))
+        {
+            while (dirent* e = ::readdir(dir))
+            {
+                int id = 0;
+                char tail = 0;
+                if (std::sscanf(e->d_name, "node%d%c", &id, &tail) != 1) { continue; }
+
+                std::ifstream f(std::string("/sys/devices/system/node/") + e->d_name + "/cpulist");
+                std::string list;
+                std::getline(f, list);
+
+                numa_node node{ id, {} };
+                for (int c : parse_cpulist(list)) {
+                    if (std::find(allowed.begin(), allowed.end(), c) != allowed.end()) {
+                        node.cpus.push_back(c);
+                    }
+                }
+                if (!node.cpus.empty()) { t.m_nodes.push_back(std::move(node)); }
+            }
+            ::closedir(dir);
+        }
+#endif
+        if (t.m_nodes.empty()) {
+            t.m_nodes.push_back(numa_node{ 0, allowed });
+        }
+
+        std::sort(t.m_nodes.begin(), t.m_nodes.end(),
+            [](const numa_node& a, const numa_node& b) { return a.id < b.id; });
+
+        return t;
+    }
+
+    numa_topology numa_topology::simulated(size_t nodes, size_t cpus)
+    {
+        numa_topology t;
+        t.m_simulated = true;
+
+        for (size_t i = 0; i < std::max<size_t>(nodes, 1); i++) {
+            numa_node node{ int(i), {} };
+            for (size_t c = 0; c < std::max<size_t>(cpus, 1); c++) {
+                node.cpus.push_back(int(i * cpus + c));
+            }
+            t.m_nodes.push_back(std::move(node));
+        }
+        return t;
+    }
+
+    int numa_topology::node_of_cpu(int cpu) const
+    {
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            const std::vector<int>& c = m_nodes[i].cpus;
+            if (std::find(c.begin(), c.end(), cpu) != c.end()) { return int(i); }
+        }
+        return -1;
+    }
+
+    int memory_node(const void* p)
+    {
+#if defined(__linux__) && defined(SYS_move_pages)
+        static const uintptr_t page = (uintptr_t) ::sysconf(_SC_PAGESIZE);
+
+        /* move_pages with no target nodes reports where the pages are */
+        void* pages[1] = { reinterpret_cast<void*>((uintptr_t) p & ~(page - 1)) };
+        int status[1] = { -1 };
+
+        if (::syscall(SYS_move_pages, 0, 1ul, pages, nullptr, status, 0) == 0 && status[0] >= 0) {
+            return status[0];
+        }
+#endif
+        return -1;
+    }
+
+    namespace detail
+    {
+        void* numa_reserve(size_t bytes)
+        {
+            bytes = std::max<size_t>(bytes, 1);
+#if defined(__linux__)
+            /* anonymous mappings aren't backed until first written */
+            void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return p == MAP_FAILED ? nullptr : p;
+#else
+            return std::malloc(bytes);
+#endif
+        }
+
+        void numa_release(void* p, size_t bytes)
+        {
+            if (!p) { return; }
+#if defined(__linux__)
+            ::munmap(p, std::max<size_t>(bytes, 1));
+#else
+            std::free(p);
+#endif
+        }
+    }
+
+
+    /*  numa_pool ---------------------------------------------------------- */
+
+    struct numa_pool::impl
+    {
+        struct task {
+            std::function<void()> fn;
+            size_t bytes;
+
+            /* placement tasks must run on their node, and aren't counted */
+            bool placement;
+        };
+
+        numa_topology topology;
+        bool steal;
+
+        std::mutex mtx;
+        std::condition_variable work;
+        std::condition_variable idle;
+
+        /* one queue per node, and the number of tasks in each which
+           other nodes may steal */
+        std::vector<std::deque<task>> queues;
+        std::vector<size_t> stealable;
+        std::vector<size_t> workers;
+        std::vector<std::thread> threads;
+
+        size_t pending = 0;
+        bool stopping = false;
+        numa_stats stats;
+
+        /*  The queue to take work from, or -1 if there is none */
+        int find_work(size_t node) const
+        {
+            if (!queues[node].empty()) { return int(node); }
+            if (!steal) { return -1; }
+
+            /* steal from the queue with the most stealable tasks */
+            int from = -1;
+            for (size_t i = 0; i < queues.size(); i++) {
+                if (stealable[i] > 0 && (from < 0 || stealable[i] > stealable[from])) { from = int(i); }
+            }
+            return from;
+        }
+
+        void worker(size_t node)
+        {
+            this_node = int(node);
+            if (!topology.is_simulated()) { pin_to(topology.node(node).cpus); }
+
+            std::unique_lock<std::mutex> lock(mtx);
+            for (;;)
+            {
+                int from = -1;
+                work.wait(lock, [&]() { return (from = find_work(node)) >= 0 || stopping; });
+                if (from < 0) { return; }
+
+                std::deque<task>& q = queues[from];
+                auto it = q.begin();
+
+                if (size_t(from) != node) {
+                    while (it->placement) { ++it; }
+                }
+
+                task t = std::move(*it);
+                q.erase(it);
+
+                if (!t.placement) {
+                    stealable[from]--;
+
+                    if (size_t(from) == node) { stats.local_tasks++;  stats.local_bytes += t.bytes; }
+                    else                      { stats.remote_tasks++; stats.remote_bytes += t.bytes; }
+                }
+
+                lock.unlock();
+                t.fn();
+                lock.lock();
+
+                if (--pending == 0) { idle.notify_all(); }
+            }
+        }
+
+        void push(size_t node, task t)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!t.placement) { stealable[node]++; }
+
+                queues[node].push_back(std::move(t));
+                pending++;
+            }
+            work.notify_all();
+        }
+    };
+
+    void numa_pool::impl_deleter::operator()(impl* p) const { delete p; }
+
+    numa_pool::numa_pool(numa_topology topology, size_t workers, bool steal)
+        : m_impl{ new impl }
+    {
+        impl& p = *m_impl;
+        p.topology = std::move(topology);
+        p.steal = steal;
+        p.queues.resize(p.topology.size());
+        p.stealable.resize(p.topology.size());
+
+        for (size_t n = 0; n < p.topology.size(); n++) {
+            p.workers.push_back(workers > 0 ? workers : p.topology.node(n).cpus.size());
+        }
+        for (size_t n = 0; n < p.topology.size(); n++) {
+            for (size_t w = 0; w < p.workers[n]; w++) {
+                p.threads.emplace_back([&p, n]() { p.worker(n); });
+            }
+        }
+    }
+
+    numa_pool::~numa_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_impl->mtx);
+            m_impl->stopping = true;
+        }
+        m_impl->work.notify_all();
+        for (auto& t : m_impl->threads) { t.join(); }
+    }
+
+    const numa_topology& numa_pool::topology() const { return m_impl->topology; }
+
+    size_t numa_pool::workers(size_t node) const { return m_impl->workers[node]; }
+
+    void numa_pool::submit(size_t node, std::function<void()> task, size_t bytes)
+    {
+        m_impl->push(node, { std::move(task), bytes, false });
+    }
+
+    void numa_pool::place(size_t node, std::function<void()> task)
+    {
+        m_impl->push(node, { std::move(task), 0, true });
+    }
+
+    void numa_pool::wait()
+    {
+        std::unique_lock<std::mutex> lock(m_impl->mtx);
+        m_impl->idle.wait(lock, [&]() { return m_impl->pending == 0; });
+    }
+
+    int numa_pool::current_node() { return this_node; }
+
+    numa_stats numa_pool::stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+        return m_impl->stats;
+    }
+
+    void numa_pool::reset_stats()
+    {
+        std::lock_guard<std::mutex> lock(m_impl->mtx);
+        m_impl->stats = numa_stats();
+    }
+}
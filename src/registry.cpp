@@ -0,0 +1,115 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "kernelpp/registry.h"
+#include "library.h"
+
+#include <unordered_map>
+
+namespace
+{
+    using isa_fn = uint32_t (*)();
+    using register_fn = void (*)(kernelpp::kernel_registry&);
+
+    std::string make_key(const char* name, const char* signature, kernelpp::compute_mode m)
+    {
+        std::string key(name);
+        key += '\x1f';
+        key += signature;
+        key += '\x1f';
+        key += kernelpp::to_str(m);
+        return key;
+    }
+
+    /* unique over all registries, so cached lookups can't be confused */
+    std::atomic<uint64_t> next_generation{ 1 };
+}
+
+namespace kernelpp
+{
+    struct kernel_registry::snapshot
+    {
+        std::unordered_map<std::string, kernel_impl> best;
+    };
+
+    kernel_registry::kernel_registry(uint32_t features)
+        : m_current{ nullptr }, m_generation{ 0 }, m_features{ features }
+    {}
+
+    kernel_registry::~kernel_registry() = default;
+
+    kernel_registry& kernel_registry::instance()
+    {
+        static kernel_registry r;
+        return r;
+    }
+
+    status kernel_registry::load_plugin(const char* path)
+    {
+        void* lib = detail::open_library(path);
+        if (!lib) { return status{ detail::library_error() }; }
+
+        isa_fn isa = reinterpret_cast<isa_fn>(detail::find_symbol(lib, "kernelpp_plugin_isa"));
+        register_fn reg = reinterpret_cast<register_fn>(detail::find_symbol(lib, "kernelpp_plugin_register"));
+
+        if (!isa || !reg) {
+            detail::close_library(lib);
+            return status{ std::string(path) + " is not a kernelpp plugin" };
+        }
+
+        const uint32_t required = isa();
+        if ((required & m_features) != required) {
+            detail::close_library(lib);
+            return status{ std::string(path) + " requires an unsupported instruction set" };
+        }
+
+        /* the library stays loaded, as its implementations are referenced */
+        reg(*this);
+        return status();
+    }
+
+    void kernel_registry::publish()
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        std::unique_ptr<snapshot> s{ new snapshot };
+
+        for (const kernel_impl& impl : m_impls)
+        {
+            if ((impl.required_isa & m_features) != impl.required_isa) { continue; }
+
+            const std::string key = make_key(impl.kernel.c_str(), impl.signature.c_str(), impl.mode);
+            auto it = s->best.find(key);
+
+            /* on a tie, the most recently added wins */
+            if (it == s->best.end()) { s->best.emplace(key, impl); }
+            else if (impl.priority >= it->second.priority) { it->second = impl; }
+        }
+
+        /* earlier snapshots are kept, as lookups may still be reading them */
+        m_current.store(s.get(), std::memory_order_release);
+        m_generation.store(next_generation.fetch_add(1), std::memory_order_release);
+
+        m_snapshots.push_back(std::move(s));
+    }
+
+    const kernel_impl* kernel_registry::find(
+        const char* name, const char* signature, compute_mode m) const
+    {
+        const snapshot* s = m_current.load(std::memory_order_acquire);
+        if (!s) { return nullptr; }
+
+        auto it = s->best.find(make_key(name, signature, m));
+        return it == s->best.end() ? nullptr : &it->second;
+    }
+}
@@ -0,0 +1,410 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "kernelpp/roofline.h"
+#include "kernelpp/avx_util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#if defined(kernelpp_WITH_AVX)
+#   include <immintrin.h>
+#endif
+
+namespace
+{
+    using namespace kernelpp;
+
+    /*  Sums a buffer `reps` times with independent accumulators, so the
+     *  loop is bound by loads.
+     */
+    KERNEL_DECL(read_bytes, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static uint64_t op(const uint64_t* data, size_t n, size_t reps);
+    };
+
+    /*  Runs `iters` iterations of independent multiply-add chains, enough
+     *  to hide their latency, so the loop is bound by arithmetic throughput.
+     *  The AVX chains are fused where the cpu supports FMA.
+     */
+    KERNEL_DECL(mul_add, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static float op(size_t iters);
+
+        /* flops per iteration */
+        template <compute_mode M>
+        static constexpr double flops() { return M == compute_mode::AVX ? 12 * 8 * 2 : 32 * 2; }
+    };
+
+    template <>
+    uint64_t read_bytes::op<compute_mode::CPU>(const uint64_t* data, size_t n, size_t reps)
+    {
+        uint64_t a = 0, b = 0, c = 0, d = 0;
+        for (size_t r = 0; r < reps; r++) {
+            for (size_t i = 0; i + 4 <= n; i += 4) {
+                a += data[i]; b += data[i + 1]; c += data[i + 2]; d += data[i + 3];
+            }
+        }
+        return a + b + c + d;
+    }
+
+    template <>
+    float mul_add::op<compute_mode::CPU>(size_t iters)
+    {
+        float x[32];
+        for (int j = 0; j < 32; j++) { x[j] = float(j + 1); }
+
+        const float a = 0.999999f, b = 1e-7f;
+
+        for (size_t i = 0; i < iters; i++) {
+            for (int j = 0; j < 32; j++) { x[j] = x[j] * a + b; }
+        }
+
+        float s = 0;
+        for (int j = 0; j < 32; j++) { s += x[j]; }
+        return s;
+    }
+
+#if defined(kernelpp_WITH_AVX)
+    kernelpp_AVX_FN
+    uint64_t read_bytes_avx(const uint64_t* data, size_t n, size_t reps)
+    {
+        __m256i a = _mm256_setzero_si256(), b = a, c = a, d = a;
+
+        for (size_t r = 0; r < reps; r++) {
+            const __m256i* p = reinterpret_cast<const __m256i*>(data);
+            for (size_t i = 0; i + 16 <= n; i += 16, p += 4) {
+                a = _mm256_add_epi64(a, _mm256_load_si256(p));
+                b = _mm256_add_epi64(b, _mm256_load_si256(p + 1));
+                c = _mm256_add_epi64(c, _mm256_load_si256(p + 2));
+                d = _mm256_add_epi64(d, _mm256_load_si256(p + 3));
+            }
+        }
+
+        alignas(32) uint64_t out[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(out),
+            _mm256_add_epi64(_mm256_add_epi64(a, b), _mm256_add_epi64(c, d)));
+
+        return out[0] + out[1] + out[2] + out[3];
+    }
+
+    kernelpp_AVX_FN
+    float mul_add_avx(size_t iters)
+    {
+        const __m256 a = _mm256_set1_ps(0.999999f);
+        const __m256 b = _mm256_set1_ps(1e-7f);
+
+        /* separate variables, so each chain stays in a register */
+        __m256 x0 = _mm256_set1_ps(1), x1 = _mm256_set1_ps(2), x2 = _mm256_set1_ps(3),
+               x3 = _mm256_set1_ps(4), x4 = _mm256_set1_ps(5), x5 = _mm256_set1_ps(6),
+               x6 = _mm256_set1_ps(7), x7 = _mm256_set1_ps(8), x8 = _mm256_set1_ps(9),
+               x9 = _mm256_set1_ps(10), x10 = _mm256_set1_ps(11), x11 = _mm256_set1_ps(12);
+
+        for (size_t i = 0; i < iters; i++) {
+            x0 = _mm256_add_ps(_mm256_mul_ps(x0, a), b);
+            x1 = _mm256_add_ps(_mm256_mul_ps(x1, a), b);
+            x2 = _mm256_add_ps(_mm256_mul_ps(x2, a), b);
+            x3 = _mm256_add_ps(_mm256_mul_ps(x3, a), b);
+            x4 = _mm256_add_ps(_mm256_mul_ps(x4, a), b);
+            x5 = _mm256_add_ps(_mm256_mul_ps(x5, a), b);
+            x6 = _mm256_add_ps(_mm256_mul_ps(x6, a), b);
+            x7 = _mm256_add_ps(_mm256_mul_ps(x7, a), b);
+            x8 = _mm256_add_ps(_mm256_mul_ps(x8, a), b);
+            x9 = _mm256_add_ps(_mm256_mul_ps(x9, a), b);
+            x10 = _mm256_add_ps(_mm256_mul_ps(x10, a), b);
+            x11 = _mm256_add_ps(_mm256_mul_ps(x11, a), b);
+        }
+
+        const __m256 s = _mm256_add_ps(
+            _mm256_add_ps(_mm256_add_ps(x0, x1), _mm256_add_ps(x2, x3)),
+            _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(x4, x5), _mm256_add_ps(x6, x7)),
+                          _mm256_add_ps(_mm256_add_ps(x8, x9), _mm256_add_ps(x10, x11))));
+
+        alignas(32) float out[8];
+        _mm256_store_ps(out, s);
+        return out[0];
+    }
+
+    /*  As `mul_add_avx`, but fused, so the peak it measures is the one
+     *  kernels compiled with FMA can reach; each lane still counts 2 flops.
+     */
+    kernelpp_FMA_FN
+    float mul_add_fma(size_t iters)
+    {
+        const __m256 a = _mm256_set1_ps(0.999999f);
+        const __m256 b = _mm256_set1_ps(1e-7f);
+
+        __m256 x0 = _mm256_set1_ps(1), x1 = _mm256_set1_ps(2), x2 = _mm256_set1_ps(3),
+               x3 = _mm256_set1_ps(4), x4 = _mm256_set1_ps(5), x5 = _mm256_set1_ps(6),
+               x6 = _mm256_set1_ps(7), x7 = _mm256_set1_ps(8), x8 = _mm256_set1_ps(9),
+               x9 = _mm256_set1_ps(10), x10 = _mm256_set1_ps(11), x11 = _mm256_set1_ps(12);
+
+        for (size_t i = 0; i < iters; i++) {
+            x0 = _mm256_fmadd_ps(x0, a, b);
+            x1 = _mm256_fmadd_ps(x1, a, b);
+            x2 = _mm256_fmadd_ps(x2, a, b);
+            x3 = _mm256_fmadd_ps(x3, a, b);
+            x4 = _mm256_fmadd_ps(x4, a, b);
+            x5 = _mm256_fmadd_ps(x5, a, b);
+            x6 = _mm256_fmadd_ps(x6, a, b);
+            x7 = _mm256_fmadd_ps(x7, a, b);
+            x8 = _mm256_fmadd_ps(x8, a, b);
+            x9 = _mm256_fmadd_ps(x9, a, b);
+            x10 = _mm256_fmadd_ps(x10, a, b);
+            x11 = _mm256_fmadd_ps(x11, a, b);
+        }
+
+        const __m256 s = _mm256_add_ps(
+            _mm256_add_ps(_mm256_add_ps(x0, x1), _mm256_add_ps(x2, x3)),
+            _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(x4, x5), _mm256_add_ps(x6, x7)),
+                          _mm256_add_ps(_mm256_add_ps(x8, x9), _mm256_add_ps(x10, x11))));
+
+        alignas(32) float out[8];
+        _mm256_store_ps(out, s);
+        return out[0];
+    }
+
+    template <>
+    uint64_t read_bytes::op<compute_mode::AVX>(const uint64_t* data, size_t n, size_t reps) {
+        return read_bytes_avx(data, n, reps);
+    }
+
+    template <>
+    float mul_add::op<compute_mode::AVX>(size_t iters) {
+        static const bool fma = (cpu_features() & isa::FMA) != 0;
+        return fma ? mul_add_fma(iters) : mul_add_avx(iters);
+    }
+#endif
+
+    /* keeps results of the measurement kernels alive */
+    volatile uint64_t sink;
+
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    /*  Doubles the amount of work until `f(work)` runs for at least
+     *  `min_seconds`, returning work per second.
+     */
+    template <typename F>
+    double rate(double min_seconds, F&& f)
+    {
+        for (size_t work = 1;; work *= 2) {
+            const auto t0 = clock::now();
+            f(work);
+            const double dt = seconds(clock::now() - t0).count();
+
+            if (dt >= min_seconds) { return work / dt; }
+        }
+    }
+
+    /*  Cache sizes by level, from sysfs where available */
+    std::vector<std::pair<int, size_t>> cache_sizes()
+    {
+        std::vector<std::pair<int, size_t>> caches;
+
+        for (int i = 0; i < 16; i++) {
+            const std::string dir =
+                "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+
+            std::ifstream level(dir + "level"), type(dir + "type"), size(dir + "size");
+            if (!level || !type || !size) { break; }
+
+            int l; std::string t, s;
+            level >> l; type >> t; size >> s;
+
+            if (t == "Instruction" || s.empty()) { continue; }
+
+            size_t bytes = std::strtoull(s.c_str(), nullptr, 10);
+            if (s.back() == 'K') { bytes <<= 10; }
+            if (s.back() == 'M') { bytes <<= 20; }
+
+            caches.emplace_back(l, bytes);
+        }
+
+        if (caches.empty()) {
+            caches = { { 1, size_t(32) << 10 }, { 2, size_t(256) << 10 }, { 3, size_t(8) << 20 } };
+        }
+
+        std::sort(caches.begin(), caches.end());
+        return caches;
+    }
+
+    bool avx_usable() {
+        return compute_traits<compute_mode::AVX>::enabled &&
+               compute_traits<compute_mode::AVX>::available();
+    }
+}
+
+namespace kernelpp
+{
+    double machine_ceilings::peak_flops(compute_mode m) const
+    {
+        switch (m) {
+        case compute_mode::AVX: return avx_flops;
+        case compute_mode::CPU: return cpu_flops;
+        default: return std::max(cpu_flops, avx_flops);
+        }
+    }
+
+    double machine_ceilings::bandwidth_for(size_t bytes) const
+    {
+        for (const bandwidth_ceiling& c : bandwidth) {
+            if (bytes <= c.bytes) { return c.bytes_per_sec; }
+        }
+        return bandwidth.empty() ? 0 : bandwidth.back().bytes_per_sec;
+    }
+
+    machine_ceilings measure_ceilings(double min_seconds, size_t dram_bytes)
+    {
+        static const char* names[] = { "L1", "L2", "L3", "L4" };
+        machine_ceilings m;
+
+        /* working sets: half of each cache level, then dram */
+        std::vector<std::pair<const char*, size_t>> sets;
+        for (const auto& c : cache_sizes()) {
+            if (c.first >= 1 && c.first <= 4) { sets.emplace_back(names[c.first - 1], c.second / 2); }
+        }
+        sets.emplace_back("DRAM", std::max(dram_bytes, sets.empty() ? 0 : sets.back().second * 8));
+
+        /* one 64 byte aligned buffer, touched up front */
+        const size_t max_words = sets.back().second / sizeof(uint64_t);
+        std::unique_ptr<uint64_t[]> raw(new uint64_t[max_words + 8]);
+        uint64_t* buf = raw.get() + (64 - (uintptr_t) raw.get() % 64) % 64 / sizeof(uint64_t);
+        std::fill(buf, buf + max_words, 1);
+
+        /* the mode is chosen here rather than by AUTO, which
+           kernelpp_STATIC_MODE may fix to a mode the machine could beat */
+        const bool avx = avx_usable();
+
+        for (const auto& s : sets) {
+            const size_t words = (s.second / sizeof(uint64_t)) & ~size_t(15);
+            if (words == 0) { continue; }
+
+            const double reps_per_sec = rate(min_seconds, [&](size_t reps) {
+                sink = avx ? run<read_bytes, compute_mode::AVX>(buf, words, reps).get<uint64_t>()
+                           : run<read_bytes, compute_mode::CPU>(buf, words, reps).get<uint64_t>();
+            });
+
+            m.bandwidth.push_back({ s.first, words * sizeof(uint64_t),
+                                    reps_per_sec * words * sizeof(uint64_t) });
+        }
+
+        m.cpu_flops = mul_add::flops<compute_mode::CPU>() * rate(min_seconds, [](size_t iters) {
+            sink = (uint64_t) run<mul_add, compute_mode::CPU>(iters).get<float>();
+        });
+
+        if (avx) {
+            m.avx_flops = mul_add::flops<compute_mode::AVX>() * rate(min_seconds, [](size_t iters) {
+                sink = (uint64_t) run<mul_add, compute_mode::AVX>(iters).get<float>();
+            });
+        }
+
+        return m;
+    }
+
+
+    /*  roofline_report ---------------------------------------------------- */
+
+    roofline_report::roofline_report(machine_ceilings ceilings)
+        : m_ceilings(std::move(ceilings))
+    {}
+
+    void roofline_report::add(const char* kernel, compute_mode mode, size_t elements,
+        double bytes_per_element, double flops_per_element, double secs)
+    {
+        roofline_sample s;
+        s.kernel = kernel;
+        s.mode = mode;
+        s.elements = elements;
+        s.seconds = secs;
+
+        const double bytes = bytes_per_element * elements;
+        const double flops = flops_per_element * elements;
+
+        s.bytes_per_sec = secs > 0 ? bytes / secs : 0;
+        s.flops_per_sec = secs > 0 ? flops / secs : 0;
+        s.intensity = bytes > 0 ? flops / bytes : 0;
+
+        const double bw = m_ceilings.bandwidth_for((size_t) bytes);
+        const double peak = m_ceilings.peak_flops(mode);
+
+        s.memory_bound = flops == 0 || s.intensity * bw < peak;
+        s.attainable_flops = s.memory_bound ? s.intensity * bw : peak;
+        s.attainable_bytes = s.memory_bound ? bw : (s.intensity > 0 ? peak / s.intensity : 0);
+
+        if (s.memory_bound) { s.efficiency = bw > 0 ? s.bytes_per_sec / bw : 0; }
+        else                { s.efficiency = peak > 0 ? s.flops_per_sec / peak : 0; }
+
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_samples.push_back(s);
+    }
+
+    std::vector<roofline_sample> roofline_report::samples() const
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_samples;
+    }
+
+    void roofline_report::write_csv(std::ostream& out) const
+    {
+        out << "kernel,mode,elements,seconds,flops_per_sec,bytes_per_sec,intensity,"
+               "attainable_flops,attainable_bytes,efficiency,bound\n";
+
+        for (const roofline_sample& s : samples()) {
+            out << s.kernel << ',' << to_str(s.mode) << ',' << s.elements << ','
+                << s.seconds << ',' << s.flops_per_sec << ',' << s.bytes_per_sec << ','
+                << s.intensity << ',' << s.attainable_flops << ',' << s.attainable_bytes << ','
+                << s.efficiency << ',' << (s.memory_bound ? "memory" : "compute") << '\n';
+        }
+    }
+
+    void roofline_report::write_json(std::ostream& out) const
+    {
+        out << "{\n  \"ceilings\": {\n    \"bandwidth\": [";
+
+        for (size_t i = 0; i < m_ceilings.bandwidth.size(); i++) {
+            const bandwidth_ceiling& c = m_ceilings.bandwidth[i];
+            out << (i ? ",\n" : "\n")
+                << "      { \"level\": \"" << c.level << "\", \"bytes\": " << c.bytes
+                << ", \"bytes_per_sec\": " << c.bytes_per_sec << " }";
+        }
+
+        out << "\n    ],\n    \"flops_per_sec\": { \"CPU\": " << m_ceilings.cpu_flops
+            << ", \"AVX\": " << m_ceilings.avx_flops << " }\n  },\n  \"kernels\": [";
+
+        const std::vector<roofline_sample> all = samples();
+        for (size_t i = 0; i < all.size(); i++) {
+            const roofline_sample& s = all[i];
+            out << (i ? ",\n" : "\n")
+                << "    { \"kernel\": \"" << s.kernel << "\", \"mode\": \"" << to_str(s.mode)
+                << "\", \"elements\": " << s.elements << ", \"seconds\": " << s.seconds
+                << ", \"flops_per_sec\": " << s.flops_per_sec
+                << ", \"bytes_per_sec\": " << s.bytes_per_sec
+                << ", \"intensity\": " << s.intensity
+                << ", \"attainable_flops\": " << s.attainable_flops
+                << ", \"attainable_bytes\": " << s.attainable_bytes
+                << ", \"efficiency\": " << s.efficiency
+                << ", \"bound\": \"" << (s.memory_bound ? "memory" : "compute") << "\" }";
+        }
+
+        out << "\n  ]\n}\n";
+    }
+}
@@ -0,0 +1,107 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "kernelpp/soa.h"
+#include "kernelpp/avx_util.h"
+
+#include <climits>
+#include <cstring>
+
+#if defined(kernelpp_WITH_AVX)
+#   include <immintrin.h>
+#endif
+
+namespace
+{
+    void gather_scalar(const uint8_t* aos, size_t stride, size_t width, size_t n, uint8_t* col)
+    {
+        switch (width) {
+        case 4:
+            for (size_t i = 0; i < n; i++) { std::memcpy(col + i * 4, aos + i * stride, 4); }
+            break;
+        case 8:
+            for (size_t i = 0; i < n; i++) { std::memcpy(col + i * 8, aos + i * stride, 8); }
+            break;
+        default:
+            for (size_t i = 0; i < n; i++) { std::memcpy(col + i * width, aos + i * stride, width); }
+        }
+    }
+
+#if defined(kernelpp_WITH_AVX)
+    /*  Gathers 8 records per iteration. Record offsets within an
+     *  iteration must fit in the 32-bit gather indices.
+     */
+    kernelpp_AVX_FN
+    size_t gather_avx(const uint8_t* aos, size_t stride, size_t width, size_t n, uint8_t* col)
+    {
+        const int s = (int) stride;
+        const __m256i idx = _mm256_setr_epi32(0, s, 2*s, 3*s, 4*s, 5*s, 6*s, 7*s);
+
+        size_t i = 0;
+        if (width == 4) {
+            for (; i + 8 <= n; i += 8) {
+                const __m256i v = _mm256_i32gather_epi32(
+                    reinterpret_cast<const int*>(aos + i * stride), idx, 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(col + i * 4), v);
+            }
+        }
+        else if (width == 8) {
+            const __m128i lo = _mm256_castsi256_si128(idx);
+            const __m128i hi = _mm256_extracti128_si256(idx, 1);
+
+            for (; i + 8 <= n; i += 8) {
+                const long long* base = reinterpret_cast<const long long*>(aos + i * stride);
+                const __m256i a = _mm256_i32gather_epi64(base, lo, 1);
+                const __m256i b = _mm256_i32gather_epi64(base, hi, 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(col + i * 8), a);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(col + i * 8 + 32), b);
+            }
+        }
+        return i;
+    }
+#endif
+}
+
+namespace kernelpp {
+namespace detail
+{
+    template <>
+    void soa_gather::op<compute_mode::CPU>(
+        const uint8_t* aos, size_t stride, size_t width, size_t n, uint8_t* col)
+    {
+        gather_scalar(aos, stride, width, n, col);
+    }
+
+#if defined(kernelpp_WITH_AVX)
+    template <>
+    void soa_gather::op<compute_mode::AVX>(
+        const uint8_t* aos, size_t stride, size_t width, size_t n, uint8_t* col)
+    {
+        size_t i = 0;
+        if ((width == 4 || width == 8) && stride <= INT_MAX / 8) {
+            i = gather_avx(aos, stride, width, n, col);
+        }
+        gather_scalar(aos + i * stride, stride, width, n - i, col + i * width);
+    }
+#endif
+
+    template <>
+    void soa_scatter::op<compute_mode::CPU>(
+        const uint8_t* col, size_t stride, size_t width, size_t n, uint8_t* aos)
+    {
+        for (size_t i = 0; i < n; i++) {
+            std::memcpy(aos + i * stride, col + i * width, width);
+        }
+    }
+}}
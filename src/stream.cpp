@@ -0,0 +1,223 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "kernelpp/stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+#   define kernelpp_STREAM_MMAP 0
+#else
+#   define kernelpp_STREAM_MMAP 1
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+namespace kernelpp
+{
+#if kernelpp_STREAM_MMAP
+
+    struct window_reader::impl
+    {
+        struct mapping {
+            void*  addr = nullptr;
+            size_t len = 0;
+        };
+
+        int    fd = -1;
+        size_t size = 0;
+        size_t window = 0;
+        size_t offset = 0;  /* offset of the next window to be mapped */
+
+        mapping current;
+        mapping ahead;
+
+        ~impl()
+        {
+            unmap(current);
+            unmap(ahead);
+            if (fd >= 0) { ::close(fd); }
+        }
+
+        static void unmap(mapping& m)
+        {
+            if (m.addr) { ::munmap(m.addr, m.len); }
+            m = mapping();
+        }
+
+        /* maps the window at `offset`, and advances `offset` */
+        bool map_next(mapping& m)
+        {
+            if (offset >= size) { return true; }
+
+            const size_t len = std::min(window, size - offset);
+            void* addr = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, (off_t) offset);
+
+            if (addr == MAP_FAILED) { return false; }
+
+            ::madvise(addr, len, MADV_SEQUENTIAL);
+            ::madvise(addr, len, MADV_WILLNEED);
+
+            m.addr = addr;
+            m.len = len;
+            offset += len;
+
+            return true;
+        }
+    };
+
+    status window_reader::open(const char* path, size_t window)
+    {
+        const size_t g = granularity();
+        window = std::max(g, ((window + g - 1) / g) * g);
+
+        std::unique_ptr<impl, impl_deleter> p{ new impl };
+
+        p->fd = ::open(path, O_RDONLY);
+        if (p->fd < 0) { return status{ std::strerror(errno) }; }
+
+        struct stat st;
+        if (::fstat(p->fd, &st) != 0) { return status{ std::strerror(errno) }; }
+
+        p->size = (size_t) st.st_size;
+        p->window = window;
+
+        m_impl = std::move(p);
+        return status();
+    }
+
+    maybe<gsl::span<const uint8_t>> window_reader::next()
+    {
+        if (!m_impl) { return error{ "window_reader is not open" }; }
+        impl& r = *m_impl;
+
+        /* release the window we're done with */
+        impl::unmap(r.current);
+
+        if (r.ahead.addr) {
+            r.current = r.ahead;
+            r.ahead = impl::mapping();
+        }
+        else if (!r.map_next(r.current)) {
+            return error{ std::strerror(errno) };
+        }
+
+        /* start reading the following window */
+        if (!r.map_next(r.ahead)) {
+            return error{ std::strerror(errno) };
+        }
+
+        return gsl::span<const uint8_t>(
+            static_cast<const uint8_t*>(r.current.addr), r.current.len);
+    }
+
+    size_t window_reader::granularity()
+    {
+        static const size_t page = (size_t) ::sysconf(_SC_PAGESIZE);
+        return page;
+    }
+
+#else
+
+    /*  Fallback for systems without mmap; windows are read in to a
+     *  single buffer without any read-ahead.
+     */
+    struct window_reader::impl
+    {
+        std::FILE* file = nullptr;
+        size_t size = 0;
+        size_t window = 0;
+        std::vector<uint8_t> buf;
+
+        ~impl() { if (file) { std::fclose(file); } }
+    };
+
+    status window_reader::open(const char* path, size_t window)
+    {
+        const size_t g = granularity();
+        window = std::max(g, ((window + g - 1) / g) * g);
+
+        std::unique_ptr<impl, impl_deleter> p{ new impl };
+
+        p->file = std::fopen(path, "rb");
+        if (!p->file) { return status{ std::strerror(errno) }; }
+
+        std::fseek(p->file, 0, SEEK_END);
+        p->size = (size_t) std::ftell(p->file);
+        std::fseek(p->file, 0, SEEK_SET);
+
+        p->window = window;
+        p->buf.resize(window);
+
+        m_impl = std::move(p);
+        return status();
+    }
+
+    maybe<gsl::span<const uint8_t>> window_reader::next()
+    {
+        if (!m_impl) { return error{ "window_reader is not open" }; }
+        impl& r = *m_impl;
+
+        size_t n = std::fread(r.buf.data(), 1, r.window, r.file);
+        if (n < r.window && std::ferror(r.file)) {
+            return error{ "read failed" };
+        }
+
+        return gsl::span<const uint8_t>(r.buf.data(), n);
+    }
+
+    size_t window_reader::granularity() { return 1 << 16; }
+
+#endif
+
+    void window_reader::impl_deleter::operator()(impl* p) const { delete p; }
+
+    window_reader::window_reader() = default;
+    window_reader::window_reader(window_reader&& other) = default;
+    window_reader::~window_reader() = default;
+
+    size_t window_reader::file_size() const { return m_impl ? m_impl->size : 0; }
+    size_t window_reader::window() const    { return m_impl ? m_impl->window : 0; }
+
+
+    maybe<double> measure_read_throughput(const char* path, size_t block)
+    {
+        using clock = std::chrono::steady_clock;
+
+        std::FILE* f = std::fopen(path, "rb");
+        if (!f) { return error{ std::strerror(errno) }; }
+
+        std::vector<uint8_t> buf(block > 0 ? block : 1);
+        size_t total = 0;
+
+        const auto t0 = clock::now();
+        for (size_t n; (n = std::fread(buf.data(), 1, buf.size(), f)) > 0;) {
+            total += n;
+        }
+        const std::chrono::duration<double> dt = clock::now() - t0;
+
+        const bool failed = std::ferror(f) != 0;
+        std::fclose(f);
+
+        if (failed) { return error{ "read failed" }; }
+        return dt.count() > 0 ? total / dt.count() : 0.0;
+    }
+}
@@ -0,0 +1,287 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/capture.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    const char* test_file = "kernelpp_capture_test.kpc";
+
+    /* y = a * x + y, with a slightly different result for AVX */
+    KERNEL_DECL(saxpy, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static float op(gsl::span<float> y, gsl::span<const float> x, float a)
+        {
+            const float eps = M == compute_mode::AVX ? 1e-6f : 0.0f;
+            float sum = 0;
+
+            for (size_t i = 0; i < size_t(y.size()); i++) {
+                y[i] += a * x[i] * (1 + eps);
+                sum += y[i];
+            }
+            return sum;
+        }
+    };
+
+    /* differs between modes by more than any tolerance */
+    KERNEL_DECL(count, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static void op(std::vector<int32_t>& v) {
+            for (int32_t& x : v) { x += M == compute_mode::AVX ? 2 : 1; }
+        }
+    };
+
+    KERNEL_DECL(count_cpu, compute_mode::CPU)
+    {
+        template <compute_mode M>
+        static void op(std::vector<int32_t>& v) {
+            for (int32_t& x : v) { x++; }
+        }
+    };
+
+    std::vector<capture_record> read_all(const char* path)
+    {
+        std::vector<capture_record> records;
+        capture_reader reader;
+
+        status s = reader.open(path);
+        EXPECT_FALSE(s);
+
+        capture_record r;
+        for (;;) {
+            maybe<bool> more = reader.next(r);
+            EXPECT_TRUE(more.is<bool>());
+
+            if (!more.is<bool>() || !more.get<bool>()) { break; }
+            records.push_back(r);
+        }
+        return records;
+    }
+
+    void capture_saxpy(bool compress)
+    {
+        capture_writer writer;
+        ASSERT_FALSE(writer.open(test_file, compress));
+
+        std::vector<float> y(100, 1.0f), x(100, 2.0f);
+        capture_runner<saxpy> r(&writer, 3);
+
+        for (int i = 0; i < 7; i++) {
+            run_with<saxpy, compute_mode::CPU>(r, gsl::span<float>(y), gsl::span<const float>(x), 0.5f);
+        }
+        writer.close();
+
+        EXPECT_EQ(2u, writer.records());
+        EXPECT_EQ(0u, writer.dropped());
+
+        std::vector<capture_record> records = read_all(test_file);
+        ASSERT_EQ(2u, records.size());
+
+        const capture_record& c = records[0];
+        EXPECT_EQ("saxpy", c.kernel);
+        EXPECT_EQ(compute_mode::CPU, c.mode);
+        EXPECT_GE(c.seconds, 0.0);
+
+        /* the third call saw y after two updates */
+        ASSERT_EQ(3u, c.args.size());
+        ASSERT_EQ(100u, c.args[0].count);
+
+        float y0;
+        std::memcpy(&y0, c.args[0].bytes.data(), sizeof(y0));
+        EXPECT_EQ(3.0f, y0);
+
+        EXPECT_EQ(capture_arg::SCALAR, c.args[2].kind);
+        EXPECT_EQ(1u, c.args[2].count);
+    }
+}
+
+TEST(capture, sample)
+{
+    capture_saxpy(false);
+    std::remove(test_file);
+}
+
+#if defined(kernelpp_WITH_ZLIB)
+
+TEST(capture, sample_compressed)
+{
+    capture_saxpy(true);
+    std::remove(test_file);
+}
+
+#endif
+
+TEST(capture, arm)
+{
+    capture_writer writer;
+    ASSERT_FALSE(writer.open(test_file));
+
+    std::vector<int32_t> v(10, 0);
+    capture_runner<count> r(&writer);
+
+    run_with<count, compute_mode::CPU>(r, v);
+    r.arm();
+    run_with<count, compute_mode::CPU>(r, v);
+    run_with<count, compute_mode::CPU>(r, v);
+    writer.close();
+
+    std::vector<capture_record> records = read_all(test_file);
+    ASSERT_EQ(1u, records.size());
+
+    int32_t v0;
+    std::memcpy(&v0, records[0].args[0].bytes.data(), sizeof(v0));
+    EXPECT_EQ(1, v0);
+
+    std::remove(test_file);
+}
+
+TEST(capture, auto_mode)
+{
+    capture_writer writer;
+    ASSERT_FALSE(writer.open(test_file));
+
+    std::vector<int32_t> v(10, 0);
+    capture_runner<count_cpu> r(&writer, 2);
+
+    /* AUTO attempts the modes count_cpu doesn't support first */
+    for (int i = 0; i < 4; i++) { ASSERT_FALSE(run_with<count_cpu>(r, v)); }
+
+    r.arm();
+    ASSERT_FALSE(run_with<count_cpu>(r, v));
+    writer.close();
+
+    std::vector<capture_record> records = read_all(test_file);
+    ASSERT_EQ(3u, records.size());
+
+    for (const capture_record& c : records) { EXPECT_EQ(compute_mode::CPU, c.mode); }
+    std::remove(test_file);
+}
+
+TEST(capture, slower_than)
+{
+    capture_writer writer;
+    ASSERT_FALSE(writer.open(test_file));
+
+    std::vector<int32_t> v(10, 0);
+    capture_runner<count> r(&writer);
+
+    r.capture_slower_than(std::chrono::hours(1));
+    for (int i = 0; i < 5; i++) { run_with<count, compute_mode::CPU>(r, v); }
+
+    EXPECT_EQ(0u, writer.records());
+    std::remove(test_file);
+}
+
+TEST(capture, replay)
+{
+    capture_writer writer;
+    ASSERT_FALSE(writer.open(test_file));
+
+    std::vector<float> y(37, 1.0f), x(37, 2.0f);
+    capture_runner<saxpy> r(&writer);
+    r.arm();
+    run_with<saxpy, compute_mode::CPU>(r, gsl::span<float>(y), gsl::span<const float>(x), 0.5f);
+    writer.close();
+
+    std::vector<capture_record> records = read_all(test_file);
+    ASSERT_EQ(1u, records.size());
+    std::remove(test_file);
+
+    replay_registry registry;
+    registry.add<saxpy, gsl::span<float>, gsl::span<const float>, float>();
+
+    replay_result cpu = replay(registry, records[0], compute_mode::CPU, 3);
+    ASSERT_FALSE(cpu.result);
+
+    /* y, x, a and the returned sum */
+    ASSERT_EQ(4u, cpu.outputs.size());
+
+    float y0;
+    std::memcpy(&y0, cpu.outputs[0].bytes.data(), sizeof(y0));
+    EXPECT_EQ(2.0f, y0);
+
+    EXPECT_TRUE(compare(cpu.outputs, cpu.outputs).matches());
+
+    if (compute_traits<compute_mode::AVX>::enabled &&
+        compute_traits<compute_mode::AVX>::available())
+    {
+        replay_result avx = replay(registry, records[0], compute_mode::AVX);
+        ASSERT_FALSE(avx.result);
+
+        capture_diff d = compare(cpu.outputs, avx.outputs);
+        EXPECT_TRUE(d.matches());
+        EXPECT_GT(d.max_rel, 0.0);
+
+        EXPECT_FALSE(compare(cpu.outputs, avx.outputs, 0.0).matches());
+    }
+
+    replay_result cuda = replay(registry, records[0], compute_mode::CUDA);
+    EXPECT_TRUE(bool(cuda.result));
+}
+
+TEST(capture, replay_errors)
+{
+    capture_record rec;
+    rec.kernel = "count";
+    rec.mode = compute_mode::CPU;
+    rec.seconds = 0;
+
+    replay_registry registry;
+    EXPECT_TRUE(bool(replay(registry, rec, compute_mode::CPU).result));
+
+    /* the argument count doesn't match the registered signature */
+    registry.add<count, std::vector<int32_t>&>();
+    EXPECT_TRUE(bool(replay(registry, rec, compute_mode::CPU).result));
+
+    /* nor does the type */
+    std::string bytes;
+    detail::capture_args(bytes, 1.0f);
+    ASSERT_FALSE(detail::capture_parse(bytes, rec.args));
+    EXPECT_TRUE(bool(replay(registry, rec, compute_mode::CPU).result));
+
+    rec.args.clear();
+    std::vector<int32_t> v = { 1, 2, 3 };
+    detail::capture_args(bytes = "", v);
+    ASSERT_FALSE(detail::capture_parse(bytes, rec.args));
+
+    replay_result cpu = replay(registry, rec, compute_mode::CPU);
+    ASSERT_FALSE(cpu.result);
+    EXPECT_EQ(1u, cpu.outputs.size());
+
+    if (compute_traits<compute_mode::AVX>::enabled &&
+        compute_traits<compute_mode::AVX>::available())
+    {
+        replay_result avx = replay(registry, rec, compute_mode::AVX);
+        capture_diff d = compare(cpu.outputs, avx.outputs);
+
+        EXPECT_TRUE(d.comparable);
+        EXPECT_EQ(3u, d.mismatched);
+    }
+}
+
+TEST(capture, not_a_capture)
+{
+    capture_reader reader;
+    EXPECT_TRUE(bool(reader.open("no_such_file.kpc")));
+}
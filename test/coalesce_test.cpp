@@ -0,0 +1,107 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/coalesce.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    std::atomic<int> batched_calls{ 0 };
+
+    KERNEL_DECL(square, compute_mode::CPU)
+    {
+        template <compute_mode M>
+        static void op(gsl::span<const int> in, gsl::span<int> out)
+        {
+            batched_calls++;
+            for (size_t i = 0; i < size_t(in.size()); i++) { out[i] = in[i] * in[i]; }
+        }
+    };
+
+    KERNEL_DECL(failing, compute_mode::CPU)
+    {
+        template <compute_mode M>
+        static error_code op(gsl::span<const int>, gsl::span<int>) {
+            return error_code::CANCELLED;
+        }
+    };
+}
+
+TEST(coalesce, single)
+{
+    coalescer<square, int, int> c(8, std::chrono::microseconds(0));
+
+    for (int i = 0; i < 10; i++) {
+        maybe<int> r = c.run(i);
+        ASSERT_TRUE(r.is<int>());
+        EXPECT_EQ(i * i, r.get<int>());
+    }
+
+    coalesce_stats s = c.stats();
+    EXPECT_EQ(10u, s.calls);
+    EXPECT_EQ(10u, s.batches);
+    EXPECT_EQ(1u, s.max_batch);
+    EXPECT_EQ(10u, s.batch_sizes[1]);
+}
+
+TEST(coalesce, concurrent)
+{
+    const int threads = 16, calls = 50;
+    coalescer<square, int, int> c(4, std::chrono::microseconds(2000));
+
+    ::batched_calls = 0;
+    std::atomic<int> failures{ 0 };
+    std::vector<std::thread> workers;
+
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (int i = 0; i < calls; i++) {
+                const int x = t * calls + i;
+                maybe<int> r = c.run(x);
+
+                if (!r.is<int>() || r.get<int>() != x * x) { failures++; }
+            }
+        });
+    }
+    for (auto& w : workers) { w.join(); }
+
+    EXPECT_EQ(0, failures.load());
+
+    coalesce_stats s = c.stats();
+    EXPECT_EQ(size_t(threads * calls), s.calls);
+    EXPECT_EQ(size_t(::batched_calls.load()), s.batches);
+    EXPECT_LE(s.max_batch, 4u);
+    EXPECT_GT(s.mean_batch(), 1.0);
+
+    size_t total = 0;
+    for (size_t n = 0; n < s.batch_sizes.size(); n++) { total += n * s.batch_sizes[n]; }
+    EXPECT_EQ(s.calls, total);
+    EXPECT_GE(s.max_wait_seconds, s.mean_wait());
+}
+
+TEST(coalesce, errors)
+{
+    coalescer<failing, int, int> c(2, std::chrono::microseconds(0));
+
+    maybe<int> r = c.run(3);
+    EXPECT_TRUE(r.is<error>());
+}
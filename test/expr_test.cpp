@@ -0,0 +1,173 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/expr.h"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace kernelpp;
+using namespace kernelpp::expr;
+
+namespace
+{
+    std::vector<float> ramp(size_t n, float scale, float offset)
+    {
+        std::vector<float> v(n);
+        for (size_t i = 0; i < n; i++) { v[i] = float(i) * scale + offset; }
+        return v;
+    }
+
+    bool avx_available()
+    {
+        return compute_traits<compute_mode::AVX>::enabled &&
+            compute_traits<compute_mode::AVX>::available();
+    }
+
+    template <compute_mode M>
+    void check_fused(size_t n)
+    {
+        std::vector<float> x = ramp(n, 0.01f, -2.0f);
+        std::vector<float> mask(n);
+        for (size_t i = 0; i < n; i++) { mask[i] = float(i % 3 == 0); }
+
+        /* the trailing element must not be written */
+        std::vector<float> z(n + 1, -1.0f);
+
+        status s = assign<M>(gsl::span<float>(z.data(), n), exp(2.0f * view(x) + 1) * view(mask));
+        ASSERT_FALSE(s);
+
+        for (size_t i = 0; i < n; i++) {
+            const float expected = std::exp(2.0f * x[i] + 1) * mask[i];
+            EXPECT_NEAR(expected, z[i], 1e-6f * std::fabs(expected)) << "i=" << i;
+        }
+        EXPECT_EQ(-1.0f, z[n]);
+    }
+}
+
+TEST(expr, fused_cpu)
+{
+    for (size_t n : { 0, 1, 7, 8, 9, 1001 }) { check_fused<compute_mode::CPU>(n); }
+}
+
+TEST(expr, fused_avx)
+{
+    if (!avx_available()) { return; }
+    for (size_t n : { 0, 1, 7, 8, 9, 1001 }) { check_fused<compute_mode::AVX>(n); }
+}
+
+TEST(expr, exp_range)
+{
+    if (!avx_available()) { return; }
+
+    std::vector<float> x = ramp(2000, 0.0875f, -87.0f);
+    std::vector<float> y(x.size());
+
+    ASSERT_FALSE(assign<compute_mode::AVX>(y, exp(view(x))));
+
+    for (size_t i = 0; i < x.size(); i++) {
+        const float expected = std::exp(x[i]);
+        EXPECT_NEAR(expected, y[i], 3e-7f * expected) << "x=" << x[i];
+    }
+}
+
+TEST(expr, exp_special)
+{
+    if (!avx_available()) { return; }
+
+    const float inf = std::numeric_limits<float>::infinity();
+    const float denorm = std::numeric_limits<float>::denorm_min();
+
+    std::vector<float> x = { std::numeric_limits<float>::quiet_NaN(), 88.5f, 88.7f, 88.72f,
+                             88.73f, 89.0f, 100.0f, inf, -inf, -88.0f, -95.0f, -103.9f,
+                             -104.0f, -120.0f };
+    std::vector<float> y(x.size());
+
+    ASSERT_FALSE(assign<compute_mode::AVX>(y, exp(view(x))));
+
+    /* the same results as the CPU */
+    for (size_t i = 0; i < x.size(); i++) {
+        const float expected = std::exp(x[i]);
+
+        if (std::isnan(expected)) { EXPECT_TRUE(std::isnan(y[i])) << "x=" << x[i]; }
+        else if (std::isinf(expected)) { EXPECT_EQ(expected, y[i]) << "x=" << x[i]; }
+        else { EXPECT_NEAR(expected, y[i], 3e-7f * expected + denorm) << "x=" << x[i]; }
+    }
+}
+
+TEST(expr, operators)
+{
+    std::vector<float> a = ramp(19, 1.0f, -9.0f);
+    std::vector<float> b = ramp(19, -0.5f, 4.0f);
+    std::vector<float> y(a.size());
+
+    auto check = [&](compute_mode m) {
+        for (size_t i = 0; i < a.size(); i++) {
+            const float s = std::sqrt(std::fabs(a[i]));
+            const float expected =
+                (a[i] < b[i] ? std::min(a[i], b[i]) : -std::max(a[i], b[i]) / 2.0f) + s;
+
+            EXPECT_FLOAT_EQ(expected, y[i]) << to_str(m) << " i=" << i;
+        }
+    };
+
+    auto e = select(view(a) < view(b), min(view(a), view(b)), -max(view(a), view(b)) / 2) + sqrt(abs(view(a)));
+
+    ASSERT_FALSE(assign<compute_mode::CPU>(y, e));
+    check(compute_mode::CPU);
+
+    if (avx_available()) {
+        std::fill(y.begin(), y.end(), 0.0f);
+
+        ASSERT_FALSE(assign<compute_mode::AVX>(y, e));
+        check(compute_mode::AVX);
+    }
+}
+
+TEST(expr, aliasing)
+{
+    std::vector<float> x = ramp(37, 1.0f, 0.0f);
+
+    ASSERT_FALSE(assign(x, view(x) * view(x) - 1));
+    for (size_t i = 0; i < x.size(); i++) { EXPECT_EQ(float(i * i) - 1, x[i]); }
+}
+
+TEST(expr, broadcast)
+{
+    std::vector<float> y(11);
+
+    ASSERT_FALSE(assign(y, scalar(3) * 2 + 1));
+    for (float v : y) { EXPECT_EQ(7.0f, v); }
+}
+
+TEST(expr, size_mismatch)
+{
+    std::vector<float> a(8), b(9), y(8);
+
+    EXPECT_TRUE(bool(assign(y, view(a) + view(b))));
+    EXPECT_TRUE(bool(assign(y, view(b) * 2)));
+}
+
+TEST(expr, threads)
+{
+    std::vector<float> x = ramp(1003, 0.5f, 0.0f);
+    std::vector<float> y(x.size(), 0.0f);
+
+    ASSERT_FALSE(assign(y, view(x) * 2 + 1, 4));
+    for (size_t i = 0; i < x.size(); i++) { EXPECT_EQ(x[i] * 2 + 1, y[i]); }
+}
@@ -155,7 +155,14 @@ TEST(kernel, call_avx)
 
     EXPECT_FALSE(run<foo_3>());
 
-    if (avx::enabled && avx::available()) {
+#if defined(kernelpp_STATIC_MODE)
+    /* AUTO is fixed at build time, and may not pick AVX even if it's there */
+    const bool expect_avx = detail::static_resolve<foo_3>::value == compute_mode::AVX;
+#else
+    const bool expect_avx = avx::enabled && avx::available();
+#endif
+
+    if (expect_avx) {
         EXPECT_EQ(0, cpu_calls);
         EXPECT_EQ(1, avx_calls);
     }
@@ -165,6 +172,19 @@ TEST(kernel, call_avx)
     }
 }
 
+#if defined(kernelpp_STATIC_MODE)
+TEST(kernel, static_mode)
+{
+    using detail::static_resolve;
+
+    static_assert(static_resolve<foo>::value == compute_mode::CPU, "");
+    static_assert(static_resolve<foo_3>::value ==
+        (static_mode == compute_mode::AVX ? compute_mode::AVX : compute_mode::CPU), "");
+
+    EXPECT_TRUE(compute_traits<static_mode>::available());
+}
+#endif
+
 TEST(avx_util, is_aligned)
 {
     using T = int32_t;
@@ -0,0 +1,199 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/memo.h"
+
+#include <numeric>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    int sum_calls = 0;
+
+    KERNEL_DECL(pure_sum, compute_mode::CPU)
+    {
+        template <compute_mode> static int op(gsl::span<const int> v) {
+            sum_calls++;
+            return std::accumulate(v.begin(), v.end(), 0);
+        }
+    };
+
+    KERNEL_DECL(pure_front, compute_mode::CPU)
+    {
+        template <compute_mode> static int op(gsl::span<const int> v) {
+            return v.empty() ? 0 : v[0];
+        }
+    };
+
+    /* {0..7, 100..107}, and with its two 32-byte stripes swapped */
+    std::vector<int> stripes(bool swapped)
+    {
+        std::vector<int> v(16);
+        for (int i = 0; i < 8; i++) {
+            v[swapped ? i + 8 : i] = i;
+            v[swapped ? i : i + 8] = 100 + i;
+        }
+        return v;
+    }
+}
+
+namespace kernelpp {
+    template <> struct is_pure<pure_sum> : std::true_type {};
+    template <> struct is_pure<pure_front> : std::true_type {};
+}
+
+TEST(memo, hash_bytes)
+{
+    std::vector<uint8_t> data(1000);
+    std::iota(data.begin(), data.end(), 0);
+
+    for (size_t len : { 0, 1, 7, 8, 31, 32, 33, 100, 1000 }) {
+        maybe<uint64_t> cpu = run<hash_bytes, compute_mode::CPU>(data.data(), len, uint64_t(1));
+        ASSERT_TRUE(cpu.is<uint64_t>());
+
+        if (compute_traits<compute_mode::AVX>::enabled &&
+            compute_traits<compute_mode::AVX>::available())
+        {
+            maybe<uint64_t> avx = run<hash_bytes, compute_mode::AVX>(data.data(), len, uint64_t(1));
+            ASSERT_TRUE(avx.is<uint64_t>());
+            EXPECT_EQ(cpu.get<uint64_t>(), avx.get<uint64_t>());
+        }
+    }
+
+    /* sensitive to content, length and seed */
+    uint64_t h = run<hash_bytes>(data.data(), size_t(64), uint64_t(0)).get<uint64_t>();
+    EXPECT_NE(h, run<hash_bytes>(data.data(), size_t(63), uint64_t(0)).get<uint64_t>());
+    EXPECT_NE(h, run<hash_bytes>(data.data(), size_t(64), uint64_t(1)).get<uint64_t>());
+    EXPECT_NE(h, run<hash_bytes>(data.data() + 1, size_t(64), uint64_t(0)).get<uint64_t>());
+}
+
+TEST(memo, hash_bytes_order)
+{
+    const std::vector<int> a = stripes(false), b = stripes(true);
+    const size_t len = a.size() * sizeof(int);
+
+    uint64_t x = run<hash_bytes, compute_mode::CPU>(a.data(), len, uint64_t(0)).get<uint64_t>();
+    uint64_t y = run<hash_bytes, compute_mode::CPU>(b.data(), len, uint64_t(0)).get<uint64_t>();
+    EXPECT_NE(x, y);
+
+    if (compute_traits<compute_mode::AVX>::enabled &&
+        compute_traits<compute_mode::AVX>::available())
+    {
+        x = run<hash_bytes, compute_mode::AVX>(a.data(), len, uint64_t(0)).get<uint64_t>();
+        y = run<hash_bytes, compute_mode::AVX>(b.data(), len, uint64_t(0)).get<uint64_t>();
+        EXPECT_NE(x, y);
+    }
+}
+
+TEST(memo, permuted)
+{
+    memo_cache cache;
+    memo_runner<pure_front> r(&cache);
+
+    const std::vector<int> a = stripes(false), b = stripes(true);
+
+    EXPECT_EQ(0, run_with<pure_front>(r, gsl::span<const int>(a)).get<int>());
+    EXPECT_EQ(100, run_with<pure_front>(r, gsl::span<const int>(b)).get<int>());
+    EXPECT_EQ(0u, cache.stats().hits);
+}
+
+TEST(memo, check)
+{
+    memo_cache cache;
+    cache.insert(1, std::make_shared<int>(7), 10);
+
+    /* the same key with a different check is a collision, not a hit */
+    EXPECT_EQ(nullptr, cache.find(1, 11));
+    ASSERT_NE(nullptr, cache.find(1, 10));
+
+    memo_stats s = cache.stats();
+    EXPECT_EQ(1u, s.hits);
+    EXPECT_EQ(1u, s.misses);
+    EXPECT_EQ(1u, s.collisions);
+}
+
+TEST(memo, hit_miss)
+{
+    memo_cache cache(64, 4);
+    memo_runner<pure_sum> r(&cache);
+
+    std::vector<int> a(100, 1), b(a);
+    sum_calls = 0;
+
+    maybe<int> x = run_with<pure_sum>(r, gsl::span<const int>(a));
+    maybe<int> y = run_with<pure_sum>(r, gsl::span<const int>(b));
+
+    ASSERT_TRUE(x.is<int>() && y.is<int>());
+    EXPECT_EQ(100, x.get<int>());
+    EXPECT_EQ(100, y.get<int>());
+    EXPECT_EQ(1, sum_calls);
+
+    b[0] = 2;
+    EXPECT_EQ(101, run_with<pure_sum>(r, gsl::span<const int>(b)).get<int>());
+    EXPECT_EQ(2, sum_calls);
+
+    memo_stats s = cache.stats();
+    EXPECT_EQ(1u, s.hits);
+    EXPECT_EQ(2u, s.misses);
+    EXPECT_EQ(2u, s.entries);
+
+    cache.clear();
+    run_with<pure_sum>(r, gsl::span<const int>(a));
+    EXPECT_EQ(3, sum_calls);
+}
+
+TEST(memo, by_address)
+{
+    memo_cache cache;
+    memo_runner<pure_sum> r(&cache, true);
+
+    std::vector<int> a(10, 1);
+    sum_calls = 0;
+
+    run_with<pure_sum>(r, gsl::span<const int>(a));
+    a[0] = 5;
+
+    /* same address and length: the stale result is returned */
+    EXPECT_EQ(10, run_with<pure_sum>(r, gsl::span<const int>(a)).get<int>());
+    EXPECT_EQ(1, sum_calls);
+
+    cache.invalidate(r.key<compute_mode::CPU>(gsl::span<const int>(a)));
+    EXPECT_EQ(14, run_with<pure_sum>(r, gsl::span<const int>(a)).get<int>());
+    EXPECT_EQ(2, sum_calls);
+}
+
+TEST(memo, eviction)
+{
+    memo_cache cache(2, 1);
+    memo_runner<pure_sum> r(&cache);
+
+    std::vector<int> v[3] = { { 1 }, { 2 }, { 3 } };
+    sum_calls = 0;
+
+    for (auto& x : v) { run_with<pure_sum>(r, gsl::span<const int>(x)); }
+    EXPECT_EQ(1u, cache.stats().evictions);
+    EXPECT_EQ(2u, cache.stats().entries);
+
+    /* v[0] was least recently used */
+    run_with<pure_sum>(r, gsl::span<const int>(v[2]));
+    EXPECT_EQ(3, sum_calls);
+    run_with<pure_sum>(r, gsl::span<const int>(v[0]));
+    EXPECT_EQ(4, sum_calls);
+}
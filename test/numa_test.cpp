@@ -0,0 +1,207 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/numa.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    /* writes the node each element was processed on */
+    KERNEL_DECL(fill_node, compute_mode::CPU)
+    {
+        template <compute_mode M>
+        static void op(gsl::span<int> chunk, int offset) {
+            for (int& x : chunk) { x = numa_pool::current_node() + offset; }
+        }
+    };
+
+    KERNEL_DECL(fill_failing, compute_mode::CPU)
+    {
+        template <compute_mode M>
+        static error_code op(gsl::span<int>) { return error_code::CANCELLED; }
+    };
+}
+
+TEST(numa, discover)
+{
+    numa_topology t = numa_topology::discover();
+
+    ASSERT_GE(t.size(), 1u);
+    EXPECT_FALSE(t.is_simulated());
+
+    for (size_t i = 0; i < t.size(); i++) {
+        EXPECT_FALSE(t.node(i).cpus.empty());
+        for (int c : t.node(i).cpus) { EXPECT_EQ(int(i), t.node_of_cpu(c)); }
+    }
+}
+
+TEST(numa, simulated)
+{
+    numa_topology t = numa_topology::simulated(2, 3);
+
+    ASSERT_EQ(2u, t.size());
+    EXPECT_TRUE(t.is_simulated());
+    EXPECT_EQ(3u, t.node(1).cpus.size());
+    EXPECT_EQ(1, t.node_of_cpu(t.node(1).cpus[0]));
+    EXPECT_EQ(-1, t.node_of_cpu(100));
+}
+
+TEST(numa, submit_local)
+{
+    numa_pool pool(numa_topology::simulated(2, 2), 0, false);
+    std::atomic<int> wrong{ 0 };
+
+    for (int i = 0; i < 100; i++) {
+        const int node = i % 2;
+        pool.submit(node, [&wrong, node]() {
+            if (numa_pool::current_node() != node) { wrong++; }
+        }, 10);
+    }
+    pool.wait();
+
+    EXPECT_EQ(0, wrong.load());
+    EXPECT_EQ(-1, numa_pool::current_node());
+
+    numa_stats s = pool.stats();
+    EXPECT_EQ(100u, s.local_tasks);
+    EXPECT_EQ(0u, s.remote_tasks);
+    EXPECT_EQ(1000u, s.local_bytes);
+    EXPECT_EQ(1.0, s.local_ratio());
+}
+
+TEST(numa, steal)
+{
+    numa_pool pool(numa_topology::simulated(2, 1), 1, true);
+    std::atomic<int> ran{ 0 };
+
+    /* all of the work is owned by node 0; node 1 may take some of it */
+    for (int i = 0; i < 200; i++) {
+        pool.submit(0, [&ran]() { ran++; std::this_thread::yield(); }, 1);
+    }
+    pool.wait();
+
+    numa_stats s = pool.stats();
+    EXPECT_EQ(200, ran.load());
+    EXPECT_EQ(200u, s.local_tasks + s.remote_tasks);
+    EXPECT_EQ(200u, s.local_bytes + s.remote_bytes);
+}
+
+TEST(numa, allocate_run)
+{
+    numa_pool pool(numa_topology::simulated(2, 2), 0, false);
+    maybe<numa_array<int>> r = pool.allocate<int>(1001);
+    ASSERT_TRUE(r.is<numa_array<int>>());
+    numa_array<int>& a = r.get<numa_array<int>>();
+
+    ASSERT_EQ(1001u, a.size());
+    ASSERT_EQ(2u, a.parts());
+    EXPECT_EQ(1001u, a.part_span(0).size() + a.part_span(1).size());
+
+    for (size_t i = 0; i < a.size(); i++) { ASSERT_EQ(0, a[i]); }
+
+    pool.reset_stats();
+    status s = pool.run<fill_node>(a, 10);
+    ASSERT_FALSE(s);
+
+    /* every chunk ran on the node which owns it */
+    for (size_t p = 0; p < a.parts(); p++) {
+        for (int x : a.part_span(p)) { ASSERT_EQ(int(a.owner(p)) + 10, x); }
+    }
+
+    numa_stats stats = pool.stats();
+    EXPECT_EQ(4u, stats.local_tasks);
+    EXPECT_EQ(1001u * sizeof(int), stats.local_bytes);
+    EXPECT_EQ(1.0, stats.local_ratio());
+}
+
+TEST(numa, placement_not_stolen)
+{
+    numa_pool pool(numa_topology::simulated(2, 1), 1, true);
+
+    /* occupy node 0, leaving node 1 idle and free to steal */
+    std::mutex mtx;
+    std::unique_lock<std::mutex> blocked(mtx);
+    pool.submit(0, [&mtx]() { std::lock_guard<std::mutex> lock(mtx); });
+
+    std::atomic<bool> allocated{ false };
+    std::thread t([&]() {
+        EXPECT_TRUE(pool.allocate<int>(100).is<numa_array<int>>());
+        allocated = true;
+    });
+
+    /* node 0's part can only be placed once node 0 is free */
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(allocated.load());
+
+    blocked.unlock();
+    t.join();
+    EXPECT_TRUE(allocated.load());
+
+    /* placement isn't counted */
+    numa_stats s = pool.stats();
+    EXPECT_EQ(1u, s.local_tasks + s.remote_tasks);
+}
+
+TEST(numa, allocate_error)
+{
+    numa_pool pool(numa_topology::simulated(2, 1));
+
+    /* more than can be mapped */
+    maybe<numa_array<int>> r = pool.allocate<int>(size_t(1) << 58);
+    EXPECT_TRUE(r.is<error>());
+
+    maybe<numa_array<int>> overflow = pool.allocate<int>(SIZE_MAX);
+    EXPECT_TRUE(overflow.is<error>());
+
+    /* nothing was queued, and the pool still works */
+    numa_stats s = pool.stats();
+    EXPECT_EQ(0u, s.local_tasks + s.remote_tasks);
+    EXPECT_TRUE(pool.allocate<int>(10).is<numa_array<int>>());
+}
+
+TEST(numa, run_error)
+{
+    numa_pool pool(numa_topology::simulated(2, 1));
+    maybe<numa_array<int>> r = pool.allocate<int>(10);
+    ASSERT_TRUE(r.is<numa_array<int>>());
+    numa_array<int>& a = r.get<numa_array<int>>();
+
+    EXPECT_TRUE(bool(pool.run<fill_failing>(a)));
+}
+
+TEST(numa, first_touch)
+{
+    numa_topology t = numa_topology::discover();
+    numa_pool pool(t, 1);
+    maybe<numa_array<int>> r = pool.allocate<int>(1 << 20);
+    ASSERT_TRUE(r.is<numa_array<int>>());
+    numa_array<int>& a = r.get<numa_array<int>>();
+
+    /* where placement is reported, each part is on its own node */
+    for (size_t p = 0; p < a.parts(); p++) {
+        const int node = memory_node(a.part_span(p).data());
+        if (node >= 0) { EXPECT_EQ(t.node(a.owner(p)).id, node); }
+    }
+}
@@ -0,0 +1,152 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/pipeline.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    KERNEL_DECL(add_one, compute_mode::CPU)
+    {
+        template <compute_mode> static void op(std::vector<int>& block) {
+            for (int& x : block) { x += 1; }
+        }
+    };
+
+    KERNEL_DECL(twice, compute_mode::CPU)
+    {
+        template <compute_mode> static void op(std::vector<int>& block) {
+            for (int& x : block) { x *= 2; }
+        }
+    };
+
+    KERNEL_DECL(reject_odd, compute_mode::CPU)
+    {
+        template <compute_mode> static error_code op(std::vector<int>& block) {
+            return block[0] % 2 ? error_code::KERNEL_FAILED : error_code::NONE;
+        }
+    };
+
+    /* produces `n` blocks, where block i = { i, i, i, ... } */
+    struct counter
+    {
+        int n, i = 0;
+        bool operator()(std::vector<int>& block) {
+            if (i == n) { return false; }
+            block.assign(64, i++);
+            return true;
+        }
+    };
+}
+
+TEST(bounded_queue, push_pop)
+{
+    bounded_queue<int> q(3);
+    EXPECT_EQ(4u, q.capacity());
+
+    for (int i = 0; i < 4; i++) { EXPECT_TRUE(q.push(i)); }
+
+    int x = 4;
+    EXPECT_FALSE(q.try_push(x));
+    EXPECT_EQ(4u, q.size());
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(q.pop(x));
+        EXPECT_EQ(i, x);
+    }
+
+    q.close();
+    EXPECT_FALSE(q.pop(x));
+}
+
+TEST(bounded_queue, concurrent)
+{
+    bounded_queue<int> q(8);
+    const int n = 10000;
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 2; p++) {
+        producers.emplace_back([&]() { for (int i = 1; i <= n; i++) { q.push(i); } });
+    }
+
+    long long sum = 0;
+    std::thread consumer([&]() { for (int x; q.pop(x);) { sum += x; } });
+
+    for (std::thread& t : producers) { t.join(); }
+    q.close();
+    consumer.join();
+
+    EXPECT_EQ(2LL * n * (n + 1) / 2, sum);
+}
+
+TEST(pipeline, ordered)
+{
+    pipeline<int> p(2);
+    p.stage<add_one, compute_mode::CPU>(2)
+     .stage<twice>(3);
+
+    std::vector<int> out;
+    status s = p.run(counter{ 100 }, [&](std::vector<int>& block) {
+        EXPECT_TRUE(std::all_of(block.begin(), block.end(),
+            [&](int x) { return x == block[0]; }));
+        out.push_back(block[0]);
+    });
+
+    EXPECT_FALSE(s);
+    ASSERT_EQ(100u, out.size());
+    for (int i = 0; i < 100; i++) { EXPECT_EQ((i + 1) * 2, out[i]); }
+
+    std::vector<stage_stats> stats = p.stats();
+    ASSERT_EQ(2u, stats.size());
+    EXPECT_STREQ("add_one", stats[0].name);
+    EXPECT_EQ(compute_mode::CPU, stats[0].mode);
+    EXPECT_EQ(100u, stats[0].blocks);
+    EXPECT_EQ(3u, stats[1].workers);
+    EXPECT_EQ(100u, stats[1].blocks);
+}
+
+TEST(pipeline, unordered)
+{
+    pipeline<int> p(4, false);
+    p.stage<add_one>(4);
+
+    std::vector<int> out;
+    EXPECT_FALSE(p.run(counter{ 50 }, [&](std::vector<int>& b) { out.push_back(b[0]); }));
+
+    std::sort(out.begin(), out.end());
+    ASSERT_EQ(50u, out.size());
+    for (int i = 0; i < 50; i++) { EXPECT_EQ(i + 1, out[i]); }
+}
+
+TEST(pipeline, failure)
+{
+    pipeline<int> p(2);
+    p.stage<reject_odd>(2)
+     .stage<twice>();
+
+    size_t sunk = 0;
+    status s = p.run(counter{ 1000 }, [&](std::vector<int>&) { sunk++; });
+
+    EXPECT_TRUE(s);
+    EXPECT_LT(sunk, 1000u);
+}
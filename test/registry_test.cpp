@@ -0,0 +1,183 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/registry.h"
+
+using namespace kernelpp;
+
+namespace
+{
+    KERNEL_DECL(scale, compute_mode::CPU)
+    {
+        using signature = int(int);
+
+        template <compute_mode M> static int op(int x) { return x * 2; }
+    };
+
+    int scale_3(int x) { return x * 3; }
+    int scale_4(int x) { return x * 4; }
+    int scale_5(int x) { return x * 5; }
+}
+
+TEST(registry, empty)
+{
+    kernel_registry r(0);
+
+    EXPECT_EQ(r.generation(), 0u);
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::CPU), nullptr);
+}
+
+TEST(registry, unpublished)
+{
+    kernel_registry r(0);
+    r.add<scale>(&scale_3, compute_mode::CPU);
+
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::CPU), nullptr);
+
+    r.publish();
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::CPU), &scale_3);
+}
+
+TEST(registry, select_priority)
+{
+    kernel_registry r(0);
+    r.add<scale>(&scale_3, compute_mode::CPU, 0, 1);
+    r.add<scale>(&scale_4, compute_mode::CPU, 0, 2);
+    r.add<scale>(&scale_5, compute_mode::CPU, 0, 0);
+    r.publish();
+
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::CPU), &scale_4);
+}
+
+TEST(registry, select_isa)
+{
+    kernel_registry r(isa::AVX | isa::AVX2);
+    r.add<scale>(&scale_3, compute_mode::AVX, isa::AVX2, 1);
+    r.add<scale>(&scale_4, compute_mode::AVX, isa::AVX512F, 2);
+    r.publish();
+
+    /* the higher priority implementation isn't supported by the host */
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::AVX), &scale_3);
+
+    kernel_registry r512(isa::AVX | isa::AVX2 | isa::AVX512F);
+    r512.add<scale>(&scale_3, compute_mode::AVX, isa::AVX2, 1);
+    r512.add<scale>(&scale_4, compute_mode::AVX, isa::AVX512F, 2);
+    r512.publish();
+
+    EXPECT_EQ(r512.find<int(int)>("scale", compute_mode::AVX), &scale_4);
+}
+
+TEST(registry, key)
+{
+    kernel_registry r(0);
+    r.add<scale>(&scale_3, compute_mode::CPU);
+    r.publish();
+
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::AVX), nullptr);
+    EXPECT_EQ(r.find<int(int)>("other", compute_mode::CPU), nullptr);
+    EXPECT_EQ(r.find<long(long)>("scale", compute_mode::CPU), nullptr);
+}
+
+TEST(registry, republish)
+{
+    kernel_registry r(0);
+    r.add<scale>(&scale_3, compute_mode::CPU);
+    r.publish();
+
+    const uint64_t gen = r.generation();
+    r.add<scale>(&scale_4, compute_mode::CPU, 0, 1);
+    r.publish();
+
+    EXPECT_NE(r.generation(), gen);
+    EXPECT_EQ(r.find<int(int)>("scale", compute_mode::CPU), &scale_4);
+}
+
+TEST(registry, runner)
+{
+    kernel_registry r(0);
+    registry_runner<scale> runner(&r);
+
+    /* falls back to the kernel's own implementation */
+    maybe<int> x = run_with<scale, compute_mode::CPU>(runner, 7);
+    ASSERT_TRUE(x.is<int>());
+    EXPECT_EQ(x.get<int>(), 14);
+
+    r.add<scale>(&scale_3, compute_mode::CPU);
+    r.publish();
+
+    x = run_with<scale, compute_mode::CPU>(runner, 7);
+    ASSERT_TRUE(x.is<int>());
+    EXPECT_EQ(x.get<int>(), 21);
+}
+
+TEST(registry, runner_mode)
+{
+    kernel_registry r(0);
+    registry_runner<scale> runner(&r);
+
+    if (!compute_traits<compute_mode::AVX>::enabled ||
+        !compute_traits<compute_mode::AVX>::available()) { return; }
+
+    /* the kernel has no avx implementation of its own */
+    maybe<int> x = run_with<scale, compute_mode::AVX>(runner, 7);
+    EXPECT_TRUE(x.is<error>());
+
+    r.add<scale>(&scale_5, compute_mode::AVX, isa::AVX2);
+    r.publish();
+
+    x = run_with<scale, compute_mode::AVX>(runner, 7);
+    EXPECT_TRUE(x.is<error>());
+
+    kernel_registry r2(isa::AVX2);
+    registry_runner<scale> runner2(&r2);
+
+    r2.add<scale>(&scale_5, compute_mode::AVX, isa::AVX2);
+    r2.publish();
+
+    x = run_with<scale, compute_mode::AVX>(runner2, 7);
+    ASSERT_TRUE(x.is<int>());
+    EXPECT_EQ(x.get<int>(), 35);
+}
+
+TEST(registry, load_plugin_missing)
+{
+    kernel_registry r;
+    status s = r.load_plugin("no_such_plugin.so");
+
+    EXPECT_TRUE(bool(s));
+}
+
+#if defined(kernelpp_TEST_PLUGIN)
+
+TEST(registry, load_plugin)
+{
+    kernel_registry r;
+    status s = r.load_plugin(kernelpp_TEST_PLUGIN);
+    ASSERT_FALSE(s) << *s;
+
+    r.add<scale>(&scale_3, compute_mode::CPU, 0, 1);
+    r.publish();
+
+    /* the plugin's implementation has the higher priority */
+    registry_runner<scale> runner(&r);
+    maybe<int> x = run_with<scale, compute_mode::CPU>(runner, 7);
+
+    ASSERT_TRUE(x.is<int>());
+    EXPECT_EQ(x.get<int>(), 700);
+}
+
+#endif
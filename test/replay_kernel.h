@@ -0,0 +1,36 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#pragma once
+
+/*  A kernel shared by test_replay_plugin.cpp and test_replay_capture.cpp,
+ *  which calls in to the library, so replaying it needs the library's
+ *  symbols to be resolvable from kernelpp_replay.
+ */
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/memo.h"
+
+namespace kernelpp_test
+{
+    KERNEL_DECL(checksum, kernelpp::compute_mode::CPU)
+    {
+        template <kernelpp::compute_mode M>
+        static uint64_t op(gsl::span<const uint8_t> data)
+        {
+            auto h = kernelpp::run<kernelpp::hash_bytes>(data.data(), size_t(data.size()), 0);
+            return h.template is<uint64_t>() ? h.template get<uint64_t>() : 0;
+        }
+    };
+}
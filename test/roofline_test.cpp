@@ -0,0 +1,114 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/roofline.h"
+
+#include <sstream>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    KERNEL_DECL(scale, compute_mode::CPU)
+    {
+        template <compute_mode> static void op(std::vector<float>& v, float a) {
+            for (float& x : v) { x *= a; }
+        }
+    };
+
+    machine_ceilings fake_ceilings()
+    {
+        machine_ceilings m;
+        m.bandwidth = { { "L1", 1000, 100e9 }, { "DRAM", 1000000, 10e9 } };
+        m.cpu_flops = 10e9;
+        m.avx_flops = 80e9;
+        return m;
+    }
+}
+
+namespace kernelpp
+{
+    template <> struct cost_traits<scale> {
+        static constexpr double bytes_per_element = 8;
+        static constexpr double flops_per_element = 1;
+    };
+}
+
+TEST(roofline, ceilings)
+{
+    machine_ceilings m = measure_ceilings(0.001, size_t(1) << 20);
+
+    ASSERT_GE(m.bandwidth.size(), 2u);
+    EXPECT_STREQ("DRAM", m.bandwidth.back().level);
+
+    for (const bandwidth_ceiling& c : m.bandwidth) { EXPECT_GT(c.bytes_per_sec, 0); }
+    EXPECT_GT(m.cpu_flops, 0);
+
+    if (compute_traits<compute_mode::AVX>::enabled &&
+        compute_traits<compute_mode::AVX>::available())
+    {
+        EXPECT_GT(m.avx_flops, 0);
+    }
+}
+
+TEST(roofline, report)
+{
+    roofline_report r(fake_ceilings());
+
+    /* 1e6 elements, 8e6 bytes from dram at 4 GB/s, 0.125 flops/byte */
+    r.add("a", compute_mode::CPU, 1000000, 8, 1, 2e-3);
+
+    /* 100 elements from L1, 100 flops/byte: compute bound */
+    r.add("b", compute_mode::AVX, 100, 1, 100, 1e-6);
+
+    std::vector<roofline_sample> s = r.samples();
+    ASSERT_EQ(2u, s.size());
+
+    EXPECT_TRUE(s[0].memory_bound);
+    EXPECT_DOUBLE_EQ(0.125, s[0].intensity);
+    EXPECT_DOUBLE_EQ(10e9, s[0].attainable_bytes);
+    EXPECT_DOUBLE_EQ(0.4, s[0].efficiency);
+
+    EXPECT_FALSE(s[1].memory_bound);
+    EXPECT_DOUBLE_EQ(80e9, s[1].attainable_flops);
+    EXPECT_DOUBLE_EQ(1e10 / 80e9, s[1].efficiency);
+
+    std::ostringstream csv, json;
+    r.write_csv(csv);
+    r.write_json(json);
+
+    EXPECT_NE(std::string::npos, csv.str().find("a,CPU,1000000,"));
+    EXPECT_NE(std::string::npos, json.str().find("\"kernel\": \"b\""));
+    EXPECT_NE(std::string::npos, json.str().find("\"level\": \"DRAM\""));
+}
+
+TEST(roofline, runner)
+{
+    roofline_report r(fake_ceilings());
+    std::vector<float> v(1000, 1.0f);
+
+    roofline_runner<scale> rr(&r, v.size());
+    EXPECT_FALSE(run_with<scale>(rr, v, 2.0f));
+
+    std::vector<roofline_sample> s = r.samples();
+    ASSERT_EQ(1u, s.size());
+    EXPECT_STREQ("scale", s[0].kernel);
+    EXPECT_EQ(compute_mode::CPU, s[0].mode);
+    EXPECT_DOUBLE_EQ(0.125, s[0].intensity);
+}
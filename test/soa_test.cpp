@@ -0,0 +1,159 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/avx_util.h"
+#include "kernelpp/soa.h"
+
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    struct particle {
+        float x, y, z;
+        int32_t id;
+        double mass;
+    };
+
+    using particles = soa<float, float, float, int32_t, double>;
+
+    std::vector<particle> make_particles(size_t n)
+    {
+        std::vector<particle> v(n);
+        for (size_t i = 0; i < n; i++) {
+            v[i] = { float(i), float(i) * 2, float(i) * 3, int32_t(i), double(i) / 2 };
+        }
+        return v;
+    }
+}
+
+TEST(soa, layout)
+{
+    particles p(37);
+
+    EXPECT_EQ(37u, p.size());
+    EXPECT_EQ(64u, p.padded_size());
+    EXPECT_EQ(37u, p.column<0>().size());
+    EXPECT_EQ(64u, p.padded_column<4>().size());
+
+    EXPECT_TRUE((is_aligned<float, 8>(p.column<0>().data())));
+    EXPECT_TRUE((is_aligned<int32_t, 8>(p.column<3>().data())));
+    EXPECT_TRUE((is_aligned<double, 4>(p.column<4>().data())));
+
+    for (double m : p.padded_column<4>()) { EXPECT_EQ(0.0, m); }
+}
+
+TEST(soa, assign_copy_to)
+{
+    for (size_t n : { 0, 1, 8, 33, 100 }) {
+        std::vector<particle> aos = make_particles(n);
+
+        particles p;
+        p.assign(gsl::span<const particle>(aos));
+        ASSERT_EQ(n, p.size());
+
+        for (size_t i = 0; i < n; i++) {
+            EXPECT_EQ(aos[i].y, p.column<1>()[i]);
+            EXPECT_EQ(aos[i].id, p.column<3>()[i]);
+            EXPECT_EQ(aos[i].mass, p.column<4>()[i]);
+        }
+        for (size_t i = n; i < p.padded_size(); i++) {
+            EXPECT_EQ(0.0f, p.padded_column<2>()[i]);
+        }
+
+        std::vector<particle> out(n);
+        p.copy_to(gsl::span<particle>(out));
+
+        for (size_t i = 0; i < n; i++) {
+            EXPECT_EQ(aos[i].x, out[i].x);
+            EXPECT_EQ(aos[i].z, out[i].z);
+            EXPECT_EQ(aos[i].mass, out[i].mass);
+        }
+    }
+}
+
+TEST(soa, resize)
+{
+    std::vector<particle> aos = make_particles(40);
+
+    particles p;
+    p.assign(gsl::span<const particle>(aos));
+
+    p.resize(10);
+    EXPECT_EQ(0.0f, p.padded_column<0>()[20]);
+
+    p.resize(100);
+    EXPECT_EQ(9.0f, p.column<0>()[9]);
+    EXPECT_EQ(0.0f, p.column<0>()[10]);
+
+    /* growing within the same padded size clears what was in the padding */
+    p.resize(10);
+    p.padded_column<0>()[20] = 1.0f;
+    p.resize(25);
+    EXPECT_EQ(9.0f, p.column<0>()[9]);
+    EXPECT_EQ(0.0f, p.column<0>()[20]);
+
+    /* as does shrinking, beyond the old size too */
+    p.padded_column<0>()[30] = 1.0f;
+    p.resize(20);
+    EXPECT_EQ(0.0f, p.padded_column<0>()[30]);
+}
+
+TEST(soa, move)
+{
+    std::vector<particle> aos = make_particles(40);
+
+    particles p;
+    p.assign(gsl::span<const particle>(aos));
+
+    particles q(std::move(p));
+    EXPECT_EQ(40u, q.size());
+    EXPECT_EQ(0u, p.size());
+    EXPECT_EQ(0u, p.padded_size());
+
+    /* the moved-from container no longer shares q's columns */
+    p.resize(40);
+    p.column<0>()[5] = -1.0f;
+    EXPECT_EQ(5.0f, q.column<0>()[5]);
+
+    particles r;
+    r = std::move(q);
+    EXPECT_EQ(40u, r.size());
+    EXPECT_EQ(0u, q.size());
+    EXPECT_EQ(39.0f, r.column<0>()[39]);
+}
+
+TEST(soa, for_each_block)
+{
+    soa<float, float> s(70);
+    for (size_t i = 0; i < s.size(); i++) { s.column<0>()[i] = float(i); }
+
+    size_t blocks = 0, total = 0;
+    s.for_each_block([&](size_t offset, gsl::span<float> a, gsl::span<float> b) {
+        EXPECT_EQ(0u, (a.size() % soa<float, float>::block));
+        EXPECT_EQ(a.size(), b.size());
+        EXPECT_EQ(float(offset), a[0]);
+
+        for (size_t i = 0; i < a.size(); i++) { b[i] = a[i] * 2; }
+        blocks++;
+        total += a.size();
+    }, 40);
+
+    EXPECT_EQ(2u, blocks);
+    EXPECT_EQ(s.padded_size(), total);
+    EXPECT_EQ(138.0f, s.column<1>()[69]);
+}
@@ -0,0 +1,132 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+#include "gtest/gtest.h"
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/stream.h"
+
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    const char* test_file = "kernelpp_stream_test.bin";
+
+    void write_file(const char* path, const std::vector<int32_t>& data)
+    {
+        std::FILE* f = std::fopen(path, "wb");
+        ASSERT_TRUE(f != nullptr);
+        if (!data.empty()) { std::fwrite(data.data(), sizeof(int32_t), data.size(), f); }
+        std::fclose(f);
+    }
+
+    std::vector<int32_t> iota(size_t n)
+    {
+        std::vector<int32_t> v(n);
+        std::iota(v.begin(), v.end(), 0);
+        return v;
+    }
+
+    struct sum_state {
+        int64_t sum = 0;
+        size_t calls = 0;
+    };
+
+    KERNEL_DECL(stream_sum, compute_mode::CPU)
+    {
+        /* stateful: carries the sum across chunks */
+        template <compute_mode> static void op(gsl::span<const int32_t> chunk, sum_state& s)
+        {
+            for (int32_t x : chunk) { s.sum += x; }
+            s.calls++;
+        }
+
+        /* stateless: returns the sum of each chunk */
+        template <compute_mode> static int64_t op(gsl::span<const int32_t> chunk)
+        {
+            int64_t sum = 0;
+            for (int32_t x : chunk) { sum += x; }
+            return sum;
+        }
+    };
+}
+
+TEST(stream, run_stateful)
+{
+    const size_t n = 100000;
+    write_file(test_file, iota(n));
+
+    stream_driver<int32_t> d(1000);
+    ASSERT_FALSE(d.open(test_file));
+
+    sum_state s;
+    EXPECT_FALSE(d.run<stream_sum>(s));
+
+    EXPECT_EQ(int64_t(n) * (n - 1) / 2, s.sum);
+    EXPECT_EQ(d.stats().chunks, s.calls);
+    EXPECT_EQ(n * sizeof(int32_t), d.stats().bytes);
+    EXPECT_GT(s.calls, 1u);
+
+    std::remove(test_file);
+}
+
+TEST(stream, reduce)
+{
+    const size_t n = 12345;
+    write_file(test_file, iota(n));
+
+    stream_driver<int32_t> d(1024);
+    ASSERT_FALSE(d.open(test_file));
+
+    maybe<int64_t> r = d.reduce<stream_sum>(int64_t(0),
+        [](int64_t acc, int64_t x) { return acc + x; });
+
+    ASSERT_TRUE(r.is<int64_t>());
+    EXPECT_EQ(int64_t(n) * (n - 1) / 2, r.get<int64_t>());
+
+    EXPECT_TRUE(measure_read_throughput(test_file).is<double>());
+    std::remove(test_file);
+}
+
+TEST(stream, empty_file)
+{
+    write_file(test_file, {});
+
+    stream_driver<int32_t> d(16);
+    ASSERT_FALSE(d.open(test_file));
+
+    sum_state s;
+    EXPECT_FALSE(d.run<stream_sum>(s));
+    EXPECT_EQ(0u, s.calls);
+
+    std::remove(test_file);
+}
+
+TEST(stream, errors)
+{
+    stream_driver<int32_t> d(16);
+    EXPECT_TRUE(d.open("kernelpp_does_not_exist.bin"));
+
+    std::FILE* f = std::fopen(test_file, "wb");
+    std::fputc(0, f);
+    std::fclose(f);
+
+    EXPECT_TRUE(d.open(test_file));
+    std::remove(test_file);
+}
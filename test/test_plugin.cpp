@@ -0,0 +1,28 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+/*  A kernel plugin loaded by registry_test.cpp */
+
+#include "kernelpp/registry.h"
+
+namespace
+{
+    int scale_plugin(int x) { return x * 100; }
+}
+
+kernelpp_PLUGIN(0)
+{
+    registry.add<int(int)>("scale", &scale_plugin, kernelpp::compute_mode::CPU, 0, 10);
+}
@@ -0,0 +1,50 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+/*  Writes a capture of kernelpp_test::checksum to the given path, for
+ *  kernelpp_replay to re-run with test_replay_plugin.cpp
+ */
+
+#include "kernelpp/capture.h"
+#include "replay_kernel.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace kernelpp;
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <capture>" << std::endl;
+        return 1;
+    }
+
+    capture_writer writer;
+    if (status s = writer.open(argv[1])) {
+        std::cerr << *s << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> data(1000);
+    for (size_t i = 0; i < data.size(); i++) { data[i] = uint8_t(i * 7); }
+
+    capture_runner<kernelpp_test::checksum> r(&writer);
+    r.arm();
+    run_with<kernelpp_test::checksum>(r, gsl::span<const uint8_t>(data));
+
+    writer.close();
+    return writer.records() == 1 ? 0 : 1;
+}
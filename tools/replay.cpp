@@ -0,0 +1,132 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+
+/*  Re-runs invocations recorded by a `capture_runner` in each compute
+ *  mode, reporting the time taken and whether the outputs agree with
+ *  those of the captured mode (or CPU, if it's unavailable).
+ *
+ *      kernelpp_replay [--plugin <path>]... [--reps <n>] [--tolerance <t>] <capture>
+ *
+ *  Kernels are provided by replay plugins; see kernelpp_REPLAY_PLUGIN.
+ */
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/capture.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace kernelpp;
+
+namespace
+{
+    const compute_mode modes[] = { compute_mode::CPU, compute_mode::AVX, compute_mode::CUDA };
+
+    bool usable(compute_mode m)
+    {
+        switch (m) {
+        case compute_mode::AVX:
+            return compute_traits<compute_mode::AVX>::enabled && compute_traits<compute_mode::AVX>::available();
+        case compute_mode::CUDA:
+            return compute_traits<compute_mode::CUDA>::enabled && compute_traits<compute_mode::CUDA>::available();
+        default:
+            return true;
+        }
+    }
+
+    int usage(const char* name)
+    {
+        std::cerr << "usage: " << name
+                  << " [--plugin <path>]... [--reps <n>] [--tolerance <t>] <capture>" << std::endl;
+        return 1;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    replay_registry& registry = replay_registry::instance();
+
+    const char* path = nullptr;
+    size_t reps = 10;
+    double tolerance = 1e-5;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--plugin") && i + 1 < argc) {
+            if (status s = registry.load_plugin(argv[++i])) {
+                std::cerr << "failed to load " << argv[i] << ": " << *s << std::endl;
+                return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--reps") && i + 1 < argc) { reps = std::strtoul(argv[++i], nullptr, 10); }
+        else if (!std::strcmp(argv[i], "--tolerance") && i + 1 < argc) { tolerance = std::atof(argv[++i]); }
+        else if (argv[i][0] != '-' && !path) { path = argv[i]; }
+        else { return usage(argv[0]); }
+    }
+    if (!path) { return usage(argv[0]); }
+
+    capture_reader reader;
+    if (status s = reader.open(path)) {
+        std::cerr << *s << std::endl;
+        return 1;
+    }
+
+    capture_record rec;
+    bool mismatch = false;
+
+    for (size_t n = 0;; n++)
+    {
+        maybe<bool> more = reader.next(rec);
+        if (more.is<error>()) {
+            std::cerr << more.get<error>() << std::endl;
+            return 1;
+        }
+        if (!more.get<bool>()) { break; }
+
+        std::printf("#%zu %s, captured %s %.3f us\n",
+            n, rec.kernel.c_str(), to_str(rec.mode), rec.seconds * 1e6);
+
+        std::vector<replay_result> results;
+        for (compute_mode m : modes) {
+            if (usable(m)) { results.push_back(replay(registry, rec, m, reps)); }
+        }
+
+        /* compare against the captured mode, if it ran */
+        const replay_result* ref = nullptr;
+        for (const replay_result& r : results) {
+            if (!r.result && (!ref || r.mode == rec.mode)) { ref = &r; }
+        }
+
+        for (const replay_result& r : results)
+        {
+            if (r.result) {
+                std::printf("  %-5s %s\n", to_str(r.mode), r.result->c_str());
+                continue;
+            }
+
+            const capture_diff d = compare(ref->outputs, r.outputs, tolerance);
+            mismatch = mismatch || !d.matches();
+
+            std::printf("  %-5s %10.3f us  %s  max abs %.3g, max rel %.3g\n",
+                to_str(r.mode), r.seconds * 1e6,
+                !d.comparable ? "incomparable" : d.mismatched ? "MISMATCH" : "ok",
+                d.max_abs, d.max_rel);
+        }
+    }
+
+    return mismatch ? 2 : 0;
+}
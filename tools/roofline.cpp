@@ -0,0 +1,182 @@
+/*  Copyright 2017 International Business Machines Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.  */
+
+/*  Measures the host's bandwidth and flop/s ceilings, then places a set
+ *  of reference kernels on the roofline for each enabled compute mode.
+ *
+ *      kernelpp_roofline [--csv] [--seconds <s>]
+ *
+ *  Writes json (or csv) to stdout.
+ */
+
+#include "kernelpp/kernel.h"
+#include "kernelpp/kernel_invoke.h"
+#include "kernelpp/avx_util.h"
+#include "kernelpp/roofline.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(kernelpp_WITH_AVX)
+#   include <immintrin.h>
+#endif
+
+using namespace kernelpp;
+
+namespace
+{
+    /* a = b + s * c */
+    KERNEL_DECL(triad, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static void op(std::vector<float>& a, const std::vector<float>& b,
+                       const std::vector<float>& c, float s);
+    };
+
+    /* x = p(x), where p is a polynomial of degree 8 */
+    KERNEL_DECL(poly8, compute_mode::CPU, compute_mode::AVX)
+    {
+        template <compute_mode M>
+        static void op(std::vector<float>& x);
+    };
+
+    const float coeffs[9] = { 1.0f, 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f, 0.015625f, 0.0078125f, 0.00390625f };
+
+    template <>
+    void triad::op<compute_mode::CPU>(std::vector<float>& a, const std::vector<float>& b,
+                                      const std::vector<float>& c, float s)
+    {
+        for (size_t i = 0; i < a.size(); i++) { a[i] = b[i] + s * c[i]; }
+    }
+
+    template <>
+    void poly8::op<compute_mode::CPU>(std::vector<float>& x)
+    {
+        for (float& v : x) {
+            float r = coeffs[8];
+            for (int k = 7; k >= 0; k--) { r = r * v + coeffs[k]; }
+            v = r;
+        }
+    }
+
+#if defined(kernelpp_WITH_AVX)
+    kernelpp_AVX_FN
+    void triad_avx(float* a, const float* b, const float* c, float s, size_t n)
+    {
+        const __m256 vs = _mm256_set1_ps(s);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(a + i, _mm256_add_ps(_mm256_loadu_ps(b + i),
+                _mm256_mul_ps(vs, _mm256_loadu_ps(c + i))));
+        }
+        for (; i < n; i++) { a[i] = b[i] + s * c[i]; }
+    }
+
+    kernelpp_AVX_FN
+    void poly8_avx(float* x, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 v = _mm256_loadu_ps(x + i);
+            __m256 r = _mm256_set1_ps(coeffs[8]);
+            for (int k = 7; k >= 0; k--) {
+                r = _mm256_add_ps(_mm256_mul_ps(r, v), _mm256_set1_ps(coeffs[k]));
+            }
+            _mm256_storeu_ps(x + i, r);
+        }
+        for (; i < n; i++) {
+            float r = coeffs[8];
+            for (int k = 7; k >= 0; k--) { r = r * x[i] + coeffs[k]; }
+            x[i] = r;
+        }
+    }
+
+    template <>
+    void triad::op<compute_mode::AVX>(std::vector<float>& a, const std::vector<float>& b,
+                                      const std::vector<float>& c, float s)
+    {
+        triad_avx(a.data(), b.data(), c.data(), s, a.size());
+    }
+
+    template <>
+    void poly8::op<compute_mode::AVX>(std::vector<float>& x) {
+        poly8_avx(x.data(), x.size());
+    }
+#endif
+}
+
+namespace kernelpp
+{
+    template <> struct cost_traits<triad> {
+        static constexpr double bytes_per_element = 12;
+        static constexpr double flops_per_element = 2;
+    };
+
+    template <> struct cost_traits<poly8> {
+        static constexpr double bytes_per_element = 8;
+        static constexpr double flops_per_element = 16;
+    };
+}
+
+namespace
+{
+    /* runs each kernel a few times over each working set size in mode M */
+    template <compute_mode M>
+    void sample(roofline_report& report)
+    {
+        if (!compute_traits<M>::enabled || !compute_traits<M>::available()) { return; }
+
+        for (const bandwidth_ceiling& ceiling : report.ceilings().bandwidth)
+        {
+            /* working set of triad is 12 bytes per element */
+            const size_t n = ceiling.bytes / 12;
+            std::vector<float> a(n, 0.0f), b(n, 1.0f), c(n, 3.0f), x(n, 0.5f);
+
+            for (int rep = 0; rep < 5; rep++) {
+                roofline_runner<triad> rt(&report, n);
+                run_with<triad, M>(rt, a, b, c, 2.0f);
+
+                roofline_runner<poly8> rp(&report, n);
+                run_with<poly8, M>(rp, x);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool csv = false;
+    double seconds = 0.1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!std::strcmp(argv[i], "--csv")) { csv = true; }
+        else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc) { seconds = std::atof(argv[++i]); }
+        else {
+            std::cerr << "usage: " << argv[0] << " [--csv] [--seconds <s>]" << std::endl;
+            return 1;
+        }
+    }
+
+    roofline_report report(measure_ceilings(seconds));
+
+    sample<compute_mode::CPU>(report);
+    sample<compute_mode::AVX>(report);
+
+    if (csv) { report.write_csv(std::cout); }
+    else     { report.write_json(std::cout); }
+
+    return 0;
+}